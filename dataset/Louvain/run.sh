@@ -1,8 +1,11 @@
+# translation units of the library (see pipeline.hpp), linked into ./louvain
+LIBRARY_SOURCES="src/distributed.cpp src/pipeline.cpp src/community.cpp src/dendrogram.cpp src/graph.cpp"
+
 modularity() {
-    echo "g++ src/louvain.cpp -o ./louvain --std=c++17"
-    g++ src/louvain.cpp -o ./louvain --std=c++17
-    echo "./louvain $1 $2"
-    ./louvain $1 $2
+    echo "g++ src/louvain.cpp $LIBRARY_SOURCES -o ./louvain --std=c++17 -pthread -O3 -march=native"
+    g++ src/louvain.cpp $LIBRARY_SOURCES -o ./louvain --std=c++17 -pthread -O3 -march=native
+    echo "./louvain $@"
+    ./louvain "$@"
     rm ./louvain
 }
 old() {
@@ -13,11 +16,128 @@ old() {
     rm ./main
 }
 
+convert() {
+    echo "g++ src/convert.cpp src/graph.cpp -o ./convert --std=c++17 -pthread -O3"
+    g++ src/convert.cpp src/graph.cpp -o ./convert --std=c++17 -pthread -O3
+    echo "./convert $@"
+    ./convert "$@"
+    rm ./convert
+}
+shards() {
+    echo "g++ src/shards.cpp $LIBRARY_SOURCES -o ./shards --std=c++17 -pthread -O3"
+    g++ src/shards.cpp $LIBRARY_SOURCES -o ./shards --std=c++17 -pthread -O3
+    echo "./shards $@"
+    ./shards "$@"
+    rm ./shards
+}
+walk() {
+    echo "g++ src/walk.cpp src/graph.cpp -o ./walk --std=c++17 -pthread -O3 -march=native"
+    g++ src/walk.cpp src/graph.cpp -o ./walk --std=c++17 -pthread -O3 -march=native
+    echo "./walk $@"
+    ./walk "$@"
+    rm ./walk
+}
+hierarchy() {
+    echo "g++ src/hierarchy.cpp src/dendrogram.cpp src/graph.cpp -o ./hierarchy --std=c++17 -pthread -O3"
+    g++ src/hierarchy.cpp src/dendrogram.cpp src/graph.cpp -o ./hierarchy --std=c++17 -pthread -O3
+    echo "./hierarchy $@"
+    ./hierarchy "$@"
+    rm ./hierarchy
+}
+
+# runs every graph/*.gr reps times (seeds 1..reps) and appends the phase times,
+# modularity and peak RSS of every run to the stats file (.csv, or .json)
+# without -e the seed does not change the clustering, the reps only repeat the timing
+# usage: sh run.sh bench [reps] [threads] [stats file]
+bench() {
+    reps=${1:-3}
+    threads=${2:-1}
+    stats=${3:-bench.csv}
+    echo "g++ src/louvain.cpp $LIBRARY_SOURCES -o ./louvain --std=c++17 -pthread -O3 -march=native"
+    g++ src/louvain.cpp $LIBRARY_SOURCES -o ./louvain --std=c++17 -pthread -O3 -march=native
+    for graph in graph/*.gr; do
+        for seed in $(seq 1 $reps); do
+            echo "./louvain $graph -t $threads -s $seed -b $stats -o /dev/null"
+            ./louvain $graph -t $threads -s $seed -b $stats -o /dev/null 2>/dev/null >/dev/null
+        done
+    done
+    rm ./louvain
+}
+
+# checks that the loose schedules (-n, -a) end within tolerance below the modularity of the
+# default run, with the same seed, on every graph/*.gr of at least 1000 edges; exits with 1
+# if one does not
+# on a handful of nodes another order of moves can end in another local optimum, that the
+# tight run cannot leave with single moves (simple_graph.gr with -n 1: 0.260 against 0.288)
+# usage: sh run.sh schedule [tolerance]
+schedule() {
+    tolerance=${1:-0.01}
+    failed=0
+    echo "g++ src/louvain.cpp $LIBRARY_SOURCES -o ./louvain --std=c++17 -pthread -O3 -march=native"
+    g++ src/louvain.cpp $LIBRARY_SOURCES -o ./louvain --std=c++17 -pthread -O3 -march=native
+    for graph in graph/*.gr; do
+        if [ $(wc -l < $graph) -lt 1000 ]; then
+            continue
+        fi
+        q=$(./louvain $graph -s 1 -o /dev/null 2>&1 >/dev/null | tail -1 | cut -d' ' -f2)
+        for options in "-n 1" "-n 2" "-a 0.01" "-a 0.001 -n 3"; do
+            loose=$(./louvain $graph -s 1 $options -o /dev/null 2>&1 >/dev/null | tail -1 | cut -d' ' -f2)
+            if awk "BEGIN { exit !($loose >= $q - $tolerance) }"; then
+                echo "ok   $graph $options: $loose (default $q)"
+            else
+                echo "FAIL $graph $options: $loose (default $q)"
+                failed=1
+            fi
+        done
+    done
+    rm ./louvain
+    return $failed
+}
+
+# builds liblouvain.a, to embed with #include "pipeline.hpp" and -Isrc -L. -llouvain -pthread
+library() {
+    for source in $LIBRARY_SOURCES; do
+        echo "g++ -c $source --std=c++17 -pthread -O3 -march=native"
+        g++ -c $source --std=c++17 -pthread -O3 -march=native || return 1
+    done
+    ar rcs liblouvain.a distributed.o pipeline.o community.o dendrogram.o graph.o
+    rm distributed.o pipeline.o community.o dendrogram.o graph.o
+}
+
 case $1 in
 "all")
-    modularity $2 $3
+    shift
+    modularity "$@"
     ;;
 "old")
     old $2 $3
     ;;
+"convert")
+    shift
+    convert "$@"
+    ;;
+"shards")
+    shift
+    shards "$@"
+    ;;
+"walk")
+    shift
+    walk "$@"
+    ;;
+"hierarchy")
+    shift
+    hierarchy "$@"
+    ;;
+"lib")
+    library
+    ;;
+"bench")
+    shift
+    bench "$@"
+    ;;
+"schedule")
+    shift
+    schedule "$@"
+    exit $?
+    ;;
 esac
@@ -1,8 +1,8 @@
 #include "community.hpp"
 
-Community::Community(string filename, int type, double minm, double rsl)
+Community::Community(string filename, int type, double minm, double rsl, int nthreads)
 {
-    g = Graph(filename, type);
+    g = Graph(filename, type, nthreads);
     size = g.num_nodes;
     community_of.resize(size);
     in.resize(size);
@@ -14,12 +14,23 @@ Community::Community(string filename, int type, double minm, double rsl)
         tot[i] = g.weighted_degree(i);
     }
     min_modularity = minm;
+    max_passes = 0;
     resolution = rsl;
+    num_threads = nthreads;
+    pruning = false;
+    move_to_empty = false;
+    num_active = 0;
+    num_visited = num_moved = 0;
+    shuffle = false;
+    verbose = true;
+    nbr_communities_of_thread.resize(num_threads);
+    for (auto& nc : nbr_communities_of_thread)
+        nc.resize(size);
 }
 
-Community::Community(Graph gc, double minm, double rsl)
+Community::Community(Graph gc, double minm, double rsl, int nthreads)
 {
-    g = gc;
+    g = move(gc);
     size = g.num_nodes;
 
     community_of.resize(size);
@@ -32,7 +43,85 @@ Community::Community(Graph gc, double minm, double rsl)
         tot[i] = g.weighted_degree(i);
     }
     min_modularity = minm;
+    max_passes = 0;
     resolution = rsl;
+    num_threads = nthreads;
+    pruning = false;
+    move_to_empty = false;
+    num_active = 0;
+    num_visited = num_moved = 0;
+    shuffle = false;
+    verbose = true;
+    nbr_communities_of_thread.resize(num_threads);
+    for (auto& nc : nbr_communities_of_thread)
+        nc.resize(size);
+}
+
+void Community::init_partition(const vector<int>& partition)
+{
+    // the graph may have grown since construction (Graph::apply_updates)
+    if (size != g.num_nodes) {
+        size = g.num_nodes;
+        community_of.resize(size);
+        in.resize(size);
+        tot.resize(size);
+        for (auto& nc : nbr_communities_of_thread)
+            nc.resize(size);
+        color_offsets.clear();
+        color_nodes.clear();
+    }
+
+    fill(in.begin(), in.end(), 0);
+    fill(tot.begin(), tot.end(), 0);
+    for (int node = 0; node < size; ++node)
+        community_of[node] = partition[node];
+
+    for (int node = 0; node < size; ++node) {
+        int comm = community_of[node];
+        pair<unsigned long, unsigned long> indices = g.neighbors(node);
+        int deg = g.num_neighbors(node);
+        double inside = g.num_selfloops(node);
+        for (int i = 0; i < deg; ++i) {
+            int neigh = g.links[indices.first + i];
+            if (neigh != node && community_of[neigh] == comm)
+                inside += (g.weights.size() == 0) ? 1 : g.weights[indices.second + i];
+        }
+        in[comm] += inside;
+        tot[comm] += g.weighted_degree(node);
+    }
+}
+
+void Community::next_graph(Graph& next)
+{
+    swap(g, next);
+    size = g.num_nodes;
+    community_of.resize(size);
+    in.resize(size);
+    tot.resize(size);
+    for (int i = 0; i < size; ++i) {
+        community_of[i] = i;
+        in[i] = g.num_selfloops(i);
+        tot[i] = g.weighted_degree(i);
+    }
+    for (auto& nc : nbr_communities_of_thread)
+        if (nc.weight.size() < size)
+            nc.resize(size);
+    active.clear();
+    num_active = 0;
+    color_offsets.clear();
+    color_nodes.clear();
+}
+
+void Community::activate(const vector<int>& nodes)
+{
+    active.assign(size, 0);
+    num_active = 0;
+    for (int node : nodes) {
+        if (!active[node]) {
+            active[node] = 1;
+            ++num_active;
+        }
+    }
 }
 
 void Community::display()
@@ -57,32 +146,24 @@ double Community::modularity()
     return q;
 }
 
-map<int, int> Community::neighboring_communities(int node)
+void Community::neighboring_communities(int node, NeighborCommunities& res)
 {
-    map<int, int> res;
-    pair<int, int> indices = g.neighbors(node);
-    int link_index = indices.first;
-    int weight_index = indices.second;
+    pair<unsigned long, unsigned long> indices = g.neighbors(node);
+    unsigned long weight_index = indices.second;
 
     int deg = g.num_neighbors(node);
 
-    res.insert(make_pair(community_of[node], 0));
+    res.clear();
+    res.add(community_of[node], 0);
 
     for (int i = 0; i < deg; ++i) {
         int neigh = g.links[indices.first + i];
-        int neighboring_communities = community_of[neigh];
-        int neigh_weight = (g.weights.size() == 0) ? 1 : g.weights[weight_index + i];
+        double neigh_weight = (g.weights.size() == 0) ? 1 : g.weights[weight_index + i];
 
         if (neigh == node)
             continue;
-        map<int, int>::iterator it = res.find(neighboring_communities);
-        if (it != res.end())
-            it->second += neigh_weight;
-        else
-            res.insert(make_pair(neighboring_communities, neigh_weight));
+        res.add(community_of[neigh], neigh_weight);
     }
-
-    return res;
 }
 
 void Community::partition2graph()
@@ -97,7 +178,7 @@ void Community::partition2graph()
             renumber[i] = final++;
 
     for (int i = 0; i < size; ++i) {
-        pair<int, int> indices = g.neighbors(i);
+        pair<unsigned long, unsigned long> indices = g.neighbors(i);
         int deg = g.num_neighbors(i);
         for (int j = 0; j < deg; ++j) {
             int neigh = g.links[indices.first + j];
@@ -120,77 +201,241 @@ void Community::display_partition()
 
 Graph Community::partition2graph_binary()
 {
-    vector<int> renumber(size, -1);
+    return partition2graph_binary(community_of);
+}
+
+Graph Community::partition2graph_binary(const vector<int>& partition)
+{
+    Graph g2;
+    partition2graph_binary(partition, g2);
+    return g2;
+}
+
+void Community::partition2graph_binary(const vector<int>& partition, Graph& g2)
+{
+    // the arrays of g2 are overwritten in place and keep their storage, except when they
+    // view memory g2 does not own (the input graph of the first level)
+    if (g2.is_view())
+        g2 = Graph();
+
+    vector<int>& renumber = contraction_renumber;
+    renumber.assign(size, -1);
     for (int node = 0; node < size; ++node)
-        ++renumber[community_of[node]];
+        ++renumber[partition[node]];
 
     int final = 0;
     for (int i = 0; i < size; ++i)
         if (renumber[i] >= 0)
             renumber[i] = final++;
 
-    vector<vector<int>> comm_nodes(final);
+    // nodes of each community, bucketed by a counting sort
+    // community comm owns comm_nodes[comm_offsets[comm] .. comm_offsets[comm + 1])
+    vector<int>& comm_offsets = contraction_offsets;
+    comm_offsets.assign(final + 1, 0);
     for (int node = 0; node < size; ++node)
-        comm_nodes[renumber[community_of[node]]].push_back(node);
+        ++comm_offsets[renumber[partition[node]] + 1];
+    for (int comm = 0; comm < final; ++comm)
+        comm_offsets[comm + 1] += comm_offsets[comm];
+    vector<int>& comm_nodes = contraction_nodes;
+    comm_nodes.resize(size);
+    vector<int>& where = contraction_where;
+    where.assign(comm_offsets.begin(), comm_offsets.end() - 1);
+    for (int node = 0; node < size; ++node)
+        comm_nodes[where[renumber[partition[node]]]++] = node;
+
+    // each thread aggregates whole communities into its own buffers and remembers
+    // where it put them; the buffers are stitched together once the sizes are known
+    links_of_thread.resize(num_threads);
+    weights_of_thread.resize(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+        links_of_thread[t].clear();
+        weights_of_thread[t].clear();
+    }
+    thread_of_comm.resize(final);
+    start_of_comm.resize(final);
+    deg_of_comm.resize(final);
+
+    parallel_for(num_threads, 0, final, [&](long comm, int thread_id) {
+        NeighborCommunities& m = nbr_communities_of_thread[thread_id];
+        m.clear();
+
+        for (int k = comm_offsets[comm]; k < comm_offsets[comm + 1]; ++k) {
+            int node = comm_nodes[k];
+            pair<unsigned long, unsigned long> indices = g.neighbors(node);
+            unsigned long weight_index = indices.second;
+            int deg = g.num_neighbors(node);
+            for (int i = 0; i < deg; ++i) {
+                int neigh = g.links[indices.first + i];
+                double neigh_weight = (g.weights.size() == 0) ? 1 : g.weights[weight_index + i];
+                m.add(renumber[partition[neigh]], neigh_weight);
+            }
+        }
+
+        // sorted neighbor lists, as the ordered map used to produce
+        sort(m.touched.begin(), m.touched.end());
+
+        vector<int>& out_links = links_of_thread[thread_id];
+        vector<float>& out_weights = weights_of_thread[thread_id];
+        thread_of_comm[comm] = thread_id;
+        start_of_comm[comm] = out_links.size();
+        deg_of_comm[comm] = m.touched.size();
+        for (int neigh_comm : m.touched) {
+            out_links.push_back(neigh_comm);
+            out_weights.push_back(m.weight[neigh_comm]);
+        }
+        m.clear();
+    });
 
     // unweighted to weighted
-    Graph g2;
-    g2.num_nodes = comm_nodes.size();
-    g2.degrees.resize(comm_nodes.size(), -1);
-    g2.links.resize(g.links.size(), -1);
-    g2.weights.resize(g.links.size(), -1);
+    g2.num_nodes = final;
+    g2.degrees.resize(final);
 
+    // the communities of this level are the original ids of the next one
+    g2.node_id_to_original_id.resize(final);
     for (int i = 0; i < size; ++i)
         if (renumber[i] >= 0)
-            g2.original_id_to_node_id[i] = renumber[i];
-
-    long where = 0;
-    int comm_deg = comm_nodes.size();
-    for (int comm = 0; comm < comm_deg; ++comm) {
-        map<int, int> m;
-        map<int, int>::iterator it;
-
-        int comm_size = comm_nodes[comm].size();
-        for (int node = 0; node < comm_size; ++node) {
-            pair<int, int> indices = g.neighbors(comm_nodes[comm][node]);
-            int link_index = indices.first;
-            int weight_index = indices.second;
-            int deg = g.num_neighbors(comm_nodes[comm][node]);
+            g2.node_id_to_original_id[renumber[i]] = i;
+    g2.original_id_to_node_id.swap(renumber);
+
+    // cumulative degree sequence
+    unsigned long cumulative = 0;
+    for (int comm = 0; comm < final; ++comm) {
+        cumulative += deg_of_comm[comm];
+        g2.degrees[comm] = cumulative;
+    }
+    g2.num_links = cumulative;
+
+    // output arrays sized exactly
+    g2.links.resize(cumulative);
+    g2.weights.resize(cumulative);
+    weight_of_comm.resize(final);
+    parallel_for(num_threads, 0, final, [&](long comm, int) {
+        const vector<int>& in_links = links_of_thread[thread_of_comm[comm]];
+        const vector<float>& in_weights = weights_of_thread[thread_of_comm[comm]];
+        unsigned long from = start_of_comm[comm];
+        unsigned long to = g2.degrees[comm] - deg_of_comm[comm];
+        double sum = 0;
+        for (unsigned long i = 0; i < deg_of_comm[comm]; ++i) {
+            g2.links[to + i] = in_links[from + i];
+            g2.weights[to + i] = in_weights[from + i];
+            sum += in_weights[from + i];
+        }
+        weight_of_comm[comm] = sum;
+    });
+
+    g2.total_weight = 0;
+    for (int comm = 0; comm < final; ++comm)
+        g2.total_weight += weight_of_comm[comm];
+    g2.compute_node_weights(num_threads);
+}
+
+void Community::refine()
+{
+    // nodes of each community, bucketed by a counting sort
+    vector<int> comm_offsets(size + 1, 0);
+    for (int node = 0; node < size; ++node)
+        ++comm_offsets[community_of[node] + 1];
+    for (int comm = 0; comm < size; ++comm)
+        comm_offsets[comm + 1] += comm_offsets[comm];
+    vector<int> comm_nodes(size);
+    vector<int> where(comm_offsets.begin(), comm_offsets.end() - 1);
+    for (int node = 0; node < size; ++node)
+        comm_nodes[where[community_of[node]]++] = node;
+
+    // state of the refined communities, indexed like community_of by a member node
+    //   sub_tot  = sum of the weighted degrees of the members
+    //   sub_ext  = weight of the links from the members to the rest of their community
+    //   sub_size = number of members
+    refined_of.resize(size);
+    vector<double> sub_tot(size), sub_ext(size), node_ext(size);
+    vector<int> sub_size(size);
+    double m2 = g.total_weight;
+
+    // communities never share nodes, so they are refined independently
+    parallel_for(num_threads, 0, size, [&](long comm, int thread_id) {
+        int first = comm_offsets[comm];
+        int last = comm_offsets[comm + 1];
+        if (first == last)
+            return;
+
+        for (int k = first; k < last; ++k) {
+            int node = comm_nodes[k];
+            pair<unsigned long, unsigned long> indices = g.neighbors(node);
+            int deg = g.num_neighbors(node);
+            double ext = 0;
             for (int i = 0; i < deg; ++i) {
                 int neigh = g.links[indices.first + i];
-                int neighboring_communities = renumber[community_of[neigh]];
-                int neigh_weight = (g.weights.size() == 0) ? 1 : g.weights[weight_index + i];
-
-                it = m.find(neighboring_communities);
-                if (it == m.end())
-                    m.insert(make_pair(neighboring_communities, neigh_weight));
-                else
-                    it->second += neigh_weight;
+                if (neigh != node && community_of[neigh] == comm)
+                    ext += (g.weights.size() == 0) ? 1 : g.weights[indices.second + i];
             }
+            refined_of[node] = node;
+            sub_tot[node] = g.weighted_degree(node);
+            sub_ext[node] = node_ext[node] = ext;
+            sub_size[node] = 1;
         }
 
-        g2.degrees[comm] = (comm == 0) ? m.size() : g2.degrees[comm - 1] + m.size();
-        g2.num_links += m.size();
-
-        // for (it = m.begin(); it != m.end(); ++it) {
-        //     g2.total_weight += it->second;
-        //     g2.links[where] = it->first;
-        //     g2.weights[where] = it->second;
-        //     ++where;
-        // }
-        for (auto item : m) {
-            g2.total_weight += item.second;
-            g2.links[where] = item.first;
-            g2.weights[where] = item.second;
-            ++where;
-        }
-    }
+        double totc = tot[comm];
+        NeighborCommunities& nbr_subs = nbr_communities_of_thread[thread_id];
 
-    // correct here?
-    g.links.resize((long)g2.num_links);
-    g.weights.resize((long)g2.num_links);
+        for (int k = first; k < last; ++k) {
+            int node = comm_nodes[k];
+            double degc = g.weighted_degree(node);
 
-    return g2;
+            // only singletons that are well connected to their community may move
+            if (sub_size[refined_of[node]] != 1)
+                continue;
+            if (node_ext[node] < resolution * degc * (totc - degc) / m2)
+                continue;
+
+            nbr_subs.clear();
+            pair<unsigned long, unsigned long> indices = g.neighbors(node);
+            int deg = g.num_neighbors(node);
+            for (int i = 0; i < deg; ++i) {
+                int neigh = g.links[indices.first + i];
+                if (neigh != node && community_of[neigh] == comm)
+                    nbr_subs.add(refined_of[neigh], (g.weights.size() == 0) ? 1 : g.weights[indices.second + i]);
+            }
+
+            // greedy merge into the well-connected subcommunity with the best gain
+            int best = node;
+            double best_links = 0;
+            double best_increase = 0;
+            for (int sub : nbr_subs.touched) {
+                if (sub_ext[sub] < resolution * sub_tot[sub] * (totc - sub_tot[sub]) / m2)
+                    continue;
+                double increase = nbr_subs.weight[sub] - resolution * sub_tot[sub] * degc / m2;
+                if (increase > best_increase || (increase > 0 && increase == best_increase && sub < best)) {
+                    best = sub;
+                    best_links = nbr_subs.weight[sub];
+                    best_increase = increase;
+                }
+            }
+            if (best == node)
+                continue;
+
+            refined_of[node] = best;
+            sub_size[node] = 0;
+            sub_tot[node] = 0;
+            ++sub_size[best];
+            sub_tot[best] += degc;
+            sub_ext[best] += node_ext[node] - 2 * best_links;
+        }
+        nbr_subs.clear();
+    }, 64);
+}
+
+vector<int> Community::aggregate_partition(const vector<int>& renum, int num_aggregates)
+{
+    vector<int> partition(num_aggregates);
+    vector<int> dense(size, -1);
+    int nb = 0;
+    for (int node = 0; node < size; ++node) {
+        int comm = community_of[node];
+        if (dense[comm] < 0)
+            dense[comm] = nb++;
+        partition[renum[refined_of[node]]] = dense[comm];
+    }
+    return partition;
 }
 
 vector<int> Community::generate_random_order(int size)
@@ -199,7 +444,7 @@ vector<int> Community::generate_random_order(int size)
     for (int i = 0; i < size; i++)
         random_order[i] = i;
     for (int i = 0; i < size - 1; i++) {
-        int rand_pos = rand() % (size - i) + i;
+        int rand_pos = generator() % (size - i) + i;
         int tmp = random_order[i];
         random_order[i] = random_order[rand_pos];
         random_order[rand_pos] = tmp;
@@ -207,52 +452,221 @@ vector<int> Community::generate_random_order(int size)
     return random_order;
 }
 
+void Community::color_graph()
+{
+    vector<int> color_of(size, -1);
+    // forbidden[c] == node while some neighbor of node already has color c
+    vector<int> forbidden;
+    int num_colors = 0;
+
+    for (int node = 0; node < size; ++node) {
+        pair<unsigned long, unsigned long> indices = g.neighbors(node);
+        int deg = g.num_neighbors(node);
+        for (int i = 0; i < deg; ++i) {
+            int neigh = g.links[indices.first + i];
+            if (color_of[neigh] >= 0)
+                forbidden[color_of[neigh]] = node;
+        }
+
+        int color = 0;
+        while (color < num_colors && forbidden[color] == node)
+            ++color;
+        if (color == num_colors) {
+            forbidden.push_back(-1);
+            ++num_colors;
+        }
+        color_of[node] = color;
+    }
+
+    // bucket the nodes by color, keeping node order inside each class
+    color_offsets.assign(num_colors + 1, 0);
+    for (int node = 0; node < size; ++node)
+        ++color_offsets[color_of[node] + 1];
+    for (int c = 0; c < num_colors; ++c)
+        color_offsets[c + 1] += color_offsets[c];
+
+    color_nodes.resize(size);
+    vector<int> where(color_offsets.begin(), color_offsets.end() - 1);
+    for (int node = 0; node < size; ++node)
+        color_nodes[where[color_of[node]]++] = node;
+}
+
+void Community::collect_empty_communities()
+{
+    vector<char> used(size, 0);
+    for (int node = 0; node < size; ++node)
+        used[community_of[node]] = 1;
+    empty_communities.clear();
+    for (int comm = size - 1; comm >= 0; --comm)
+        if (!used[comm])
+            empty_communities.push_back(comm);
+}
+
+void Community::move_nodes_sequential()
+{
+    NeighborCommunities& nbr_communities = nbr_communities_of_thread[0];
+
+    // for each node: remove the node from its community and insert it in the best community
+    for (int k = 0; k < size; k++) {
+        int node = node_order.empty() ? k : node_order[k];
+        if (pruning) {
+            if (!active[node])
+                continue;
+            active[node] = 0;
+            --num_active;
+        }
+        ++num_visited;
+        int community = community_of[node];
+
+        // computation of all neighboring communities of current node
+        neighboring_communities(node, nbr_communities);
+
+        // remove node from its current community
+        remove(node, community, nbr_communities.weight[community]);
+
+        // compute the nearest community for node, all the candidates at once
+        // default choice for future insertion is the former community
+        // ties go to the smallest community id, as with the ordered map used before
+        // (the node is already removed, so its community needs no correction)
+        nbr_communities.pack(tot, -1, 0);
+        int best = nbr_communities.best(resolution * g.weighted_degree(node) / g.total_weight);
+        int best_community = (best < 0) ? community : nbr_communities.touched[best];
+        double best_num_links = nbr_communities.weight[best_community];
+        // the current community is the first candidate
+        double own_increase = nbr_communities.gains[0];
+
+        // staying costs modularity and no neighbor is better: start a new community
+        if (move_to_empty && best_community == community && own_increase < 0 && !empty_communities.empty()) {
+            best_community = empty_communities.back();
+            empty_communities.pop_back();
+            best_num_links = 0;
+        }
+
+        // insert node in the nearest community
+        //      cerr << "insert " << node << " in " << best_community << " " << best_increase << endl;
+        insert(node, best_community, best_num_links);
+
+        if (best_community != community) {
+            ++num_moved;
+            if (pruning)
+                activate_neighbors(node, best_community);
+        }
+    }
+}
+
+void Community::move_nodes_colored()
+{
+    if (color_offsets.empty())
+        color_graph();
+
+    int num_colors = color_offsets.size() - 1;
+    int max_class = 0;
+    for (int c = 0; c < num_colors; ++c)
+        max_class = max(max_class, color_offsets[c + 1] - color_offsets[c]);
+
+    // decisions of the current class, indexed by position inside the class
+    vector<int> best_community(max_class);
+    vector<double> best_num_links(max_class);
+    vector<double> own_num_links(max_class);
+
+    for (int c = 0; c < num_colors; ++c) {
+        int first = color_offsets[c];
+        int class_size = color_offsets[c + 1] - first;
+
+        // nodes of one class are never adjacent, so every decision only reads
+        // the state left by the previous classes
+        parallel_for(num_threads, 0, class_size, [&](long k, int thread_id) {
+            int node = color_nodes[first + k];
+            if (pruning && !active[node]) {
+                best_community[k] = SKIPPED_NODE;
+                return;
+            }
+            int community = community_of[node];
+            NeighborCommunities& nbr_communities = nbr_communities_of_thread[thread_id];
+            neighboring_communities(node, nbr_communities);
+
+            // same choice as move_nodes_sequential, with the node virtually removed
+            double degc = g.weighted_degree(node);
+            nbr_communities.pack(tot, community, degc);
+            int candidate = nbr_communities.best(resolution * degc / g.total_weight);
+            int best = (candidate < 0) ? community : nbr_communities.touched[candidate];
+            double best_links = (candidate < 0) ? 0 : nbr_communities.weight[best];
+            double own_increase = nbr_communities.gains[0];
+            // EMPTY_COMMUNITY: an empty community is picked when the move is applied
+            if (move_to_empty && best == community && own_increase < 0)
+                best = EMPTY_COMMUNITY;
+            best_community[k] = best;
+            best_num_links[k] = best_links;
+            own_num_links[k] = nbr_communities.weight[community];
+        });
+
+        for (int k = 0; k < class_size; ++k) {
+            int node = color_nodes[first + k];
+            if (best_community[k] == SKIPPED_NODE)
+                continue;
+            ++num_visited;
+            if (pruning) {
+                active[node] = 0;
+                --num_active;
+            }
+            if (best_community[k] == EMPTY_COMMUNITY) {
+                if (empty_communities.empty())
+                    continue;
+                best_community[k] = empty_communities.back();
+                empty_communities.pop_back();
+                best_num_links[k] = 0;
+            }
+            if (best_community[k] == community_of[node])
+                continue;
+            remove(node, community_of[node], own_num_links[k]);
+            insert(node, best_community[k], best_num_links[k]);
+            ++num_moved;
+            if (pruning)
+                activate_neighbors(node, best_community[k]);
+        }
+    }
+}
+
 double Community::one_level()
 {
     int num_pass_done = 0;
     double new_mod = modularity();
     double cur_mod = -1;
-    vector<int> random_order = generate_random_order(size);
+    if (shuffle)
+        node_order = generate_random_order(size);
+    // with pruning every node starts flagged, unless activate() chose the nodes
+    if (pruning && active.size() != size) {
+        active.assign(size, 1);
+        num_active = size;
+    }
 
     // repeat while
     //   there is an improvement of modularity
     //   or there is an improvement of modularity greater than a given epsilon
-    //   or a predefined number of pass have been done
-    while (new_mod - cur_mod > min_modularity) {
+    //   and the pass limit of the level has not been reached
+    //   (with pruning) and some node is still flagged
+    while (new_mod - cur_mod > min_modularity && (max_passes == 0 || num_pass_done < max_passes)) {
         cur_mod = new_mod;
         num_pass_done++;
-        // for each node: remove the node from its community and insert it in the best community
-        for (int node = 0; node < size; node++) {
-            int community = community_of[node];
+        PhaseTimer timer("pass", num_pass_done);
+        num_visited = num_moved = 0;
+        if (move_to_empty)
+            collect_empty_communities();
 
-            // computation of all neighboring communities of current node
-            map<int, int> nbr_communities = neighboring_communities(node);
-
-            // remove node from its current community
-            remove(node, community, nbr_communities.find(community)->second);
-
-            // compute the nearest community for node
-            // default choice for future insertion is the former community
-            int best_community = community;
-            int best_num_links = 0; // nbr_communities.find(community)->second;
-            double best_increase = 0.; // modularity_gain(node, best_community, best_num_links);
-            for (auto c : nbr_communities) {
-                double increase = modularity_gain(node, c.first, c.second);
-                if (increase > best_increase) {
-                    best_community = c.first;
-                    best_num_links = c.second;
-                    best_increase = increase;
-                }
-            }
-
-            // insert node in the nearest community
-            //      cerr << "insert " << node << " in " << best_community << " " << best_increase << endl;
-            insert(node, best_community, best_num_links);
-        }
+        if (num_threads > 1)
+            move_nodes_colored();
+        else
+            move_nodes_sequential();
 
         new_mod = modularity();
-        cerr << "pass number " << num_pass_done << ": " << cur_mod << " ---> " << new_mod << endl;
+        if (verbose)
+            cerr << "pass number " << num_pass_done << ": " << cur_mod << " ---> " << new_mod
+                 << " (visited " << num_visited << ", moved " << num_moved << ")" << endl;
+
+        if (pruning && num_active == 0)
+            break;
     }
+    active.clear();
 
     return new_mod;
 }
\ No newline at end of file
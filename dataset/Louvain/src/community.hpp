@@ -1,4 +1,71 @@
-#include "graph.cpp"
+#pragma once
+#include "graph.hpp"
+#include "gain.hpp"
+
+// markers used by move_nodes_colored in place of a community
+#define SKIPPED_NODE -1
+#define EMPTY_COMMUNITY -2
+
+// accumulates the links from one node to each of its neighboring communities
+// weight has one slot per community (-1 while the community has not been seen) and
+// touched lists the communities seen since the last clear(), in first-seen order,
+// so resetting costs O(deg) and no memory is allocated once the slots exist
+class NeighborCommunities {
+public:
+    vector<double> weight;
+    vector<int> touched;
+
+    void resize(int size)
+    {
+        weight.assign(size, -1);
+        touched.clear();
+    }
+
+    inline void add(int comm, double w)
+    {
+        if (weight[comm] < 0) {
+            weight[comm] = 0;
+            touched.push_back(comm);
+        }
+        weight[comm] += w;
+    }
+
+    inline void clear()
+    {
+        for (int comm : touched)
+            weight[comm] = -1;
+        touched.clear();
+    }
+
+    // the touched communities laid out contiguously for best_candidate:
+    // candidate_weight[i] and candidate_tot[i] belong to touched[i]
+    vector<double> candidate_weight;
+    vector<double> candidate_tot;
+    vector<double> gains;
+
+    // fills the candidate arrays from weight and tot, without the degree of the node
+    // (removed from its community) in the tot of own_community
+    inline void pack(const vector<double>& tot, int own_community, double degree)
+    {
+        int n = touched.size();
+        if (candidate_weight.size() < n) {
+            candidate_weight.resize(n);
+            candidate_tot.resize(n);
+            gains.resize(n);
+        }
+        for (int i = 0; i < n; ++i) {
+            int comm = touched[i];
+            candidate_weight[i] = weight[comm];
+            candidate_tot[i] = tot[comm] - (comm == own_community ? degree : 0.);
+        }
+    }
+
+    // index in touched of the best community, -1 if no move gains modularity
+    inline int best(double scale)
+    {
+        return best_candidate(candidate_weight.data(), candidate_tot.data(), touched.data(), touched.size(), scale, gains.data());
+    }
+};
 
 class Community {
 public:
@@ -11,30 +78,106 @@ public:
     vector<int> community_of;
 
     // used to compute the modularity participation of each community
-    vector<int> in, tot;
+    // kept as two dense double arrays: the gain loop only reads tot, so it streams
+    // through one array instead of striding over interleaved in/tot pairs
+    vector<double> in, tot;
 
     // a new pass is computed if the last one has generated an increase
     // greater than min_modularity
     // if 0. even a minor increase is enough to go for one more pass
     double min_modularity;
 
+    // at most that many passes per level (0: no limit)
+    int max_passes;
+
     // resolution
     double resolution;
 
+    // number of threads used by the local-moving phase
+    // 1 keeps the original sequential sweep over the nodes
+    int num_threads;
+
+    // nodes grouped by color (no two adjacent nodes share a color)
+    // color c owns color_nodes[color_offsets[c] .. color_offsets[c + 1])
+    vector<int> color_offsets;
+    vector<int> color_nodes;
+
+    // pruning: only the nodes flagged in active are examined by a pass
+    // a node that moves flags its neighbors outside its new community,
+    // and the level ends once no node is flagged
+    bool pruning;
+    vector<char> active;
+    int num_active;
+
+    // Leiden-style moves: a node whose own community costs modularity and that has no
+    // better neighboring community moves to an empty community instead of staying
+    // empty_communities is refilled at the start of every pass
+    bool move_to_empty;
+    vector<int> empty_communities;
+
+    // subcommunity of each node computed by refine(), always inside community_of[node]
+    vector<int> refined_of;
+
+    // nodes examined and nodes moved by the last pass
+    int num_visited, num_moved;
+
+    // visit the nodes of every level in a random order drawn from generator
+    // (move_nodes_sequential only), instead of in increasing id order
+    bool shuffle;
+    mt19937 generator;
+    vector<int> node_order;
+
+    // print the progress of every pass
+    bool verbose;
+
+    // one accumulator per thread, reused for every node
+    vector<NeighborCommunities> nbr_communities_of_thread;
+
+    // neighbor lists aggregated by every thread in partition2graph_binary, reused by every level
+    vector<vector<int>> links_of_thread;
+    vector<vector<float>> weights_of_thread;
+
+    // scratch arrays of partition2graph_binary, reused by every level (the graphs only shrink,
+    // so they are allocated by the first contraction); the renumbering is swapped with the
+    // original_id_to_node_id of the graph it builds
+    vector<int> contraction_renumber;
+    vector<int> contraction_offsets;
+    vector<int> contraction_nodes;
+    vector<int> contraction_where;
+    vector<int> thread_of_comm;
+    vector<unsigned long> start_of_comm;
+    vector<unsigned long> deg_of_comm;
+    vector<double> weight_of_comm;
+
     // constructors
     // reads graph from file using graph constructor
-    Community(string filename, int type, double min_modularity, double rsl = 1);
-    // copy graph
-    Community(Graph g, double min_modularity, double rsl = 1);
+    Community(string filename, int type, double min_modularity, double rsl = 1, int nthreads = 1);
+    // takes the graph over (move it in to avoid a copy)
+    Community(Graph g, double min_modularity, double rsl = 1, int nthreads = 1);
+
+    // start from the given partition instead of singletons
+    // the community state is resized if the graph has changed size
+    void init_partition(const vector<int>& partition);
+
+    // moves on to the graph of the next level: swaps it with g, so that next gets the graph
+    // of this level back as the arena of the next contraction, and resets the communities
+    // to singletons in the arrays of this level (no reallocation, the graphs only shrink)
+    void next_graph(Graph& next);
+
+    // with pruning, flag only these nodes for the first pass of the next one_level
+    void activate(const vector<int>& nodes);
 
     // display the community of each node
     void display();
 
     // remove the node from its current communtiy with which it has dnodecomm links
-    inline void remove(int node, int comm, int dnodecomm);
+    inline void remove(int node, int comm, double dnodecomm);
 
     // insert the node in comm with which it shares dnodecomm links
-    inline void insert(int node, int comm, int dnodecomm);
+    inline void insert(int node, int comm, double dnodecomm);
+
+    // flag the neighbors of node that are not in comm for the next visits
+    inline void activate_neighbors(int node, int comm);
 
     // compute the gain of modularity if node where inserted in comm
     // given that node has dnodecomm links to comm.  The formula is:
@@ -45,11 +188,12 @@ public:
     //       d(node,com) = number of links from node to comm
     //       deg(node)   = node degree
     //       m           = number of links
-    inline double modularity_gain(int node, int comm, int dnodecomm);
+    inline double modularity_gain(int node, int comm, double dnodecomm);
 
-    // compute the set of neighboring communities of node
+    // compute the set of neighboring communities of node into res (cleared first)
     // for each community, gives the number of links from node to comm
-    map<int, int> neighboring_communities(int node);
+    // the current community of node is always the first entry of res.touched
+    void neighboring_communities(int node, NeighborCommunities& res);
 
     // compute the modularity of the curernt partition
     double modularity();
@@ -62,6 +206,35 @@ public:
 
     // generates the graph of communities as computed by one_level
     Graph partition2graph_binary();
+    // generates the graph of the given partition (e.g. refined_of)
+    Graph partition2graph_binary(const vector<int>& partition);
+    // same, into the arrays of g2, which keep their storage across levels
+    void partition2graph_binary(const vector<int>& partition, Graph& g2);
+
+    // Leiden refinement: splits every community into well-connected subcommunities
+    // starting from singletons, a node still alone in its subcommunity and well connected
+    // to its community merges into the well-connected subcommunity of the same community
+    // with the best modularity gain (the greedy, deterministic variant of Leiden's step)
+    void refine();
+
+    // community of every node of the graph built by partition2graph_binary(refined_of),
+    // renumbered from 0, given the renumbering of that graph (its original_id_to_node_id)
+    vector<int> aggregate_partition(const vector<int>& renum, int num_aggregates);
+
+    // greedy distance-1 coloring of the graph, fills color_offsets and color_nodes
+    void color_graph();
+
+    // fills empty_communities with the ids no node belongs to
+    void collect_empty_communities();
+
+    // one sweep over all nodes, moving each into its best neighboring community
+    void move_nodes_sequential();
+
+    // one sweep over the color classes
+    // the nodes of a class are independent, so their best moves are computed in parallel
+    // and then applied; two nodes of a class may still join the same community in the
+    // same step, so the result can differ slightly from the sequential sweep
+    void move_nodes_colored();
 
     // compute communities of the graph for one level
     // return the modularity
@@ -70,7 +243,7 @@ public:
     vector<int> generate_random_order(int size);
 };
 
-inline void Community::remove(int node, int comm, int dnodecomm)
+inline void Community::remove(int node, int comm, double dnodecomm)
 {
     assert(node >= 0 && node < size);
     tot[comm] -= g.weighted_degree(node);
@@ -78,7 +251,7 @@ inline void Community::remove(int node, int comm, int dnodecomm)
     community_of[node] = -1;
 }
 
-inline void Community::insert(int node, int comm, int dnodecomm)
+inline void Community::insert(int node, int comm, double dnodecomm)
 {
     assert(node >= 0 && node < size);
 
@@ -87,14 +260,27 @@ inline void Community::insert(int node, int comm, int dnodecomm)
     community_of[node] = comm;
 }
 
-inline double Community::modularity_gain(int node, int comm, int dnodecomm)
+inline void Community::activate_neighbors(int node, int comm)
+{
+    pair<unsigned long, unsigned long> indices = g.neighbors(node);
+    int deg = g.num_neighbors(node);
+    for (int i = 0; i < deg; ++i) {
+        int neigh = g.links[indices.first + i];
+        if (community_of[neigh] != comm && !active[neigh]) {
+            active[neigh] = 1;
+            ++num_active;
+        }
+    }
+}
+
+inline double Community::modularity_gain(int node, int comm, double dnodecomm)
 {
     assert(node >= 0 && node < size);
 
     double totc = (double)tot[comm];
     double degc = (double)g.weighted_degree(node);
     double m2 = (double)g.total_weight;
-    double dnc = (double)dnodecomm;
+    double dnc = dnodecomm;
 
     return (dnc - resolution * totc * degc / m2);
 }
\ No newline at end of file
@@ -0,0 +1,50 @@
+#include "graph.hpp"
+
+// converts an edge list (.gr) into the binary CSR format (.bgr)
+// usage: ./convert <input.gr> <output.bgr> [-t <threads>] [-m <MB>] [-W] [-R <order>]
+// with -m the edge list is sorted out of core with that much memory for edges (also with -W)
+// with -W it is read as "u v w" and duplicate edges are merged into one weighted edge
+// with -R the nodes are renumbered for locality (degree, rcm or rabbit) before writing
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        cerr << "usage: " << argv[0] << " <input.gr> <output.bgr> [-t <threads>] [-m <MB>] [-W] [-R <order>]" << endl;
+        return 1;
+    }
+
+    string input_path = argv[1];
+    string output_path = argv[2];
+    int num_threads = 1;
+    size_t memory_megabytes = 0;
+    int type = UNWEIGHTED;
+    int reorder = REORDER_NONE;
+    for (int i = 3; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "-t" && i + 1 < argc)
+            num_threads = atoi(argv[++i]);
+        else if (option == "-m" && i + 1 < argc)
+            memory_megabytes = atol(argv[++i]);
+        else if (option == "-W")
+            type = WEIGHTED;
+        else if (option == "-R" && i + 1 < argc)
+            reorder = Graph::reorder_method(argv[++i]);
+    }
+    if (num_threads <= 0)
+        num_threads = max(1u, thread::hardware_concurrency());
+
+    if (memory_megabytes > 0) {
+        Graph::build_binary(input_path, output_path, memory_megabytes << 20, num_threads, type == WEIGHTED);
+        input_path = output_path;
+    }
+    Graph g(input_path, type, num_threads);
+    if (reorder != REORDER_NONE)
+        g.reorder(reorder, num_threads);
+    if (input_path != output_path || reorder != REORDER_NONE)
+        g.write_binary(output_path);
+
+    cerr << output_path << " : "
+         << g.num_nodes << " nodes, "
+         << g.num_links << " links, "
+         << g.total_weight << " weight." << endl;
+    return 0;
+}
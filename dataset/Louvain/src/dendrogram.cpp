@@ -0,0 +1,81 @@
+#include "dendrogram.hpp"
+
+Dendrogram::Dendrogram()
+{
+}
+
+Dendrogram::Dendrogram(const Graph& g)
+{
+    node_id_to_original_id.assign(g.node_id_to_original_id.begin(), g.node_id_to_original_id.end());
+}
+
+void Dendrogram::add_level(const vector<int>& community_of, const vector<int>& renum)
+{
+    vector<int> level(community_of.size());
+    for (int node = 0; node < community_of.size(); ++node)
+        level[node] = renum[community_of[node]];
+    levels.push_back(move(level));
+}
+
+vector<int> Dendrogram::partition_at(int level) const
+{
+    assert(level >= 0 && level < num_levels());
+    vector<int> partition = levels[0];
+    for (int l = 1; l <= level; ++l)
+        for (int& c : partition)
+            c = levels[l][c];
+    return partition;
+}
+
+void Dendrogram::write_binary(string filepath) const
+{
+    DendrogramHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DENDROGRAM_MAGIC, sizeof(header.magic));
+    header.version = DENDROGRAM_VERSION;
+    header.num_levels = levels.size();
+    header.num_nodes = node_id_to_original_id.size();
+
+    ofstream output(filepath, ios::binary);
+    assert(output.good());
+    const char padding[8] = { 0 };
+    auto write_array = [&](const vector<int>& a) {
+        size_t bytes = a.size() * sizeof(int);
+        output.write((const char*)a.data(), bytes);
+        output.write(padding, (8 - bytes % 8) % 8);
+    };
+    output.write((const char*)&header, sizeof(header));
+    write_array(node_id_to_original_id);
+    for (const vector<int>& level : levels) {
+        uint64_t size = level.size();
+        output.write((const char*)&size, sizeof(size));
+        write_array(level);
+    }
+    assert(output.good());
+}
+
+void Dendrogram::read_binary(string filepath)
+{
+    ifstream input(filepath, ios::binary);
+    assert(input.good());
+    DendrogramHeader header;
+    input.read((char*)&header, sizeof(header));
+    assert(memcmp(header.magic, DENDROGRAM_MAGIC, sizeof(header.magic)) == 0);
+    assert(header.version == DENDROGRAM_VERSION);
+
+    char padding[8];
+    auto read_array = [&](vector<int>& a, size_t size) {
+        a.resize(size);
+        size_t bytes = size * sizeof(int);
+        input.read((char*)a.data(), bytes);
+        input.read(padding, (8 - bytes % 8) % 8);
+    };
+    read_array(node_id_to_original_id, header.num_nodes);
+    levels.resize(header.num_levels);
+    for (vector<int>& level : levels) {
+        uint64_t size;
+        input.read((char*)&size, sizeof(size));
+        read_array(level, size);
+    }
+    assert(input.good());
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "graph.hpp"
+
+// binary dendrogram file (.dendro), written by Dendrogram::write_binary
+//   header
+//   original ids  int32 x num_nodes            original id of every input node
+//   for each level: uint64 size, int32 x size  (padded to 8 bytes)
+#define DENDROGRAM_MAGIC "LVDENDRO"
+#define DENDROGRAM_VERSION 1
+
+struct DendrogramHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_levels;
+    uint64_t num_nodes;
+};
+
+// the whole hierarchy computed by the level loop
+// levels[k][node] is the community of a node of level k, which is also its node at level k + 1
+// the nodes of level 0 are the nodes of the input graph
+class Dendrogram {
+public:
+    vector<vector<int>> levels;
+
+    // original id of every node of the input graph
+    vector<int> node_id_to_original_id;
+
+    Dendrogram();
+    Dendrogram(const Graph& g);
+
+    // records a level from the communities of its nodes and the renumbering
+    // done by partition2graph_binary (renum[community_of[node]])
+    void add_level(const vector<int>& community_of, const vector<int>& renum);
+    void add_level(const vector<int>& level) { levels.push_back(level); }
+
+    int num_levels() const { return levels.size(); }
+
+    // community of an input node at level k, O(k)
+    inline int community_at(int node, int level) const;
+
+    // community of every input node at level k, for O(1) lookups afterwards
+    vector<int> partition_at(int level) const;
+
+    void write_binary(string filepath) const;
+    void read_binary(string filepath);
+};
+
+inline int Dendrogram::community_at(int node, int level) const
+{
+    assert(level >= 0 && level < num_levels());
+    for (int l = 0; l <= level; ++l)
+        node = levels[l][node];
+    return node;
+}
@@ -0,0 +1,519 @@
+#include "distributed.hpp"
+
+static void write_all(int fd, const char* data, size_t bytes)
+{
+    while (bytes > 0) {
+        ssize_t n = write(fd, data, bytes);
+        if (n < 0 && errno == EINTR)
+            continue;
+        assert(n > 0);
+        data += n;
+        bytes -= n;
+    }
+}
+
+static void read_all(int fd, char* data, size_t bytes)
+{
+    while (bytes > 0) {
+        ssize_t n = read(fd, data, bytes);
+        if (n < 0 && errno == EINTR)
+            continue;
+        assert(n > 0);
+        data += n;
+        bytes -= n;
+    }
+}
+
+unique_ptr<SocketTransport> SocketTransport::fork_workers(int num_workers)
+{
+    assert(num_workers >= 1);
+
+    // sockets[i][j] is the end of the pair between workers i and j that worker i uses
+    vector<vector<int>> sockets(num_workers, vector<int>(num_workers, -1));
+    for (int i = 0; i < num_workers; ++i) {
+        for (int j = i + 1; j < num_workers; ++j) {
+            int pair[2];
+            int result = socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+            assert(result == 0);
+            sockets[i][j] = pair[0];
+            sockets[j][i] = pair[1];
+        }
+    }
+
+    // nothing buffered may be printed twice
+    cout.flush();
+    cerr.flush();
+    int rank = 0;
+    vector<pid_t> children;
+    for (int w = 1; w < num_workers; ++w) {
+        pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0) {
+            rank = w;
+            children.clear();
+            break;
+        }
+        children.push_back(pid);
+    }
+
+    for (int i = 0; i < num_workers; ++i)
+        for (int j = 0; j < num_workers; ++j)
+            if (i != rank && sockets[i][j] >= 0)
+                close(sockets[i][j]);
+
+    unique_ptr<SocketTransport> transport(new SocketTransport());
+    transport->my_rank = rank;
+    transport->peers = sockets[rank];
+    transport->children = children;
+    return transport;
+}
+
+SocketTransport::~SocketTransport()
+{
+    for (int fd : peers)
+        if (fd >= 0)
+            close(fd);
+    for (pid_t pid : children)
+        waitpid(pid, NULL, 0);
+}
+
+void SocketTransport::send(int to, const void* data, size_t bytes)
+{
+    uint64_t length = bytes;
+    write_all(peers[to], (const char*)&length, sizeof(length));
+    write_all(peers[to], (const char*)data, bytes);
+}
+
+void SocketTransport::recv(int from, vector<char>& data)
+{
+    uint64_t length;
+    read_all(peers[from], (char*)&length, sizeof(length));
+    data.resize(length);
+    read_all(peers[from], data.data(), length);
+}
+
+vector<vector<char>> exchange_bytes(Transport& t, vector<vector<char>>& outgoing)
+{
+    int num_workers = t.size();
+    int rank = t.rank();
+    vector<vector<char>> incoming(num_workers);
+    incoming[rank] = move(outgoing[rank]);
+    for (int step = 1; step < num_workers; ++step) {
+        int to = (rank + step) % num_workers;
+        int from = (rank - step + num_workers) % num_workers;
+        thread sender([&] { t.send(to, outgoing[to].data(), outgoing[to].size()); });
+        t.recv(from, incoming[from]);
+        sender.join();
+    }
+    return incoming;
+}
+
+void Shard::build(Transport& t, vector<int> node_starts, vector<unsigned long> node_degrees,
+    const vector<int>& global_links, vector<float> link_weights, double graph_weight)
+{
+    starts = move(node_starts);
+    begin = starts[t.rank()];
+    end = starts[t.rank() + 1];
+    degrees = move(node_degrees);
+    weights = move(link_weights);
+    total_weight = graph_weight;
+
+    ghosts.clear();
+    for (int neigh : global_links)
+        if (neigh < begin || neigh >= end)
+            ghosts.push_back(neigh);
+    sort(ghosts.begin(), ghosts.end());
+    ghosts.erase(unique(ghosts.begin(), ghosts.end()), ghosts.end());
+    ghost_offsets.resize(t.size() + 1);
+    for (int w = 0; w <= t.size(); ++w)
+        ghost_offsets[w] = lower_bound(ghosts.begin(), ghosts.end(), starts[w]) - ghosts.begin();
+
+    links.resize(global_links.size());
+    for (size_t i = 0; i < global_links.size(); ++i) {
+        int neigh = global_links[i];
+        if (neigh >= begin && neigh < end)
+            links[i] = neigh - begin;
+        else
+            links[i] = num_owned() + (lower_bound(ghosts.begin(), ghosts.end(), neigh) - ghosts.begin());
+    }
+
+    weighted_degrees.assign(num_owned(), 0);
+    for (int node = 0; node < num_owned(); ++node) {
+        if (weights.empty())
+            weighted_degrees[node] = degrees[node] - first_neighbor(node);
+        else
+            for (unsigned long i = first_neighbor(node); i < degrees[node]; ++i)
+                weighted_degrees[node] += weights[i];
+    }
+
+    // every worker tells the owners of its ghosts which of their nodes it needs
+    vector<vector<int>> requests(t.size());
+    for (int w = 0; w < t.size(); ++w)
+        requests[w].assign(ghosts.begin() + ghost_offsets[w], ghosts.begin() + ghost_offsets[w + 1]);
+    send_lists = exchange(t, requests);
+    for (vector<int>& list : send_lists)
+        for (int& node : list)
+            node -= begin;
+}
+
+DistributedCommunity::DistributedCommunity(Transport& transport, string filepath)
+    : t(transport)
+{
+    vector<int> starts;
+    vector<unsigned long> degrees;
+    vector<int> links;
+    vector<float> weights;
+    BinaryGraphHeader header = Graph::read_binary_shard(filepath, t.size(), t.rank(), starts, degrees, links, weights, original_ids);
+    shard.build(t, starts, degrees, links, weights, header.total_weight);
+
+    level_node_of.resize(shard.num_owned());
+    for (int node = 0; node < shard.num_owned(); ++node)
+        level_node_of[node] = shard.begin + node;
+    num_visited = num_moved = 0;
+    verbose = false;
+    reset_singletons();
+}
+
+void DistributedCommunity::reset_singletons()
+{
+    int n = shard.num_owned();
+    community_of.resize(n);
+    tot.resize(n);
+    members.resize(n);
+    for (int node = 0; node < n; ++node) {
+        community_of[node] = shard.begin + node;
+        tot[node] = shard.weighted_degrees[node];
+        members[node] = 1;
+    }
+    ghost_community = shard.ghosts;
+    remote_communities.clear();
+    remote_slot.clear();
+    remote_tot_start.clear();
+    remote_members_start.clear();
+    synchronize();
+}
+
+double DistributedCommunity::modularity()
+{
+    int n = shard.num_owned();
+    double inside = 0;
+    for (int node = 0; node < n; ++node) {
+        for (unsigned long i = shard.first_neighbor(node); i < shard.degrees[node]; ++i) {
+            int neigh = shard.links[i];
+            int comm = (neigh < n) ? community_of[neigh] : ghost_community[neigh - n];
+            if (comm == community_of[node])
+                inside += shard.weights.empty() ? 1 : shard.weights[i];
+        }
+    }
+    double squares = 0;
+    for (int s = 0; s < n; ++s)
+        if (members[s] > 0)
+            squares += tot[s] * tot[s];
+
+    double m2 = shard.total_weight;
+    return all_reduce_sum(t, inside) / m2 - all_reduce_sum(t, squares) / (m2 * m2);
+}
+
+void DistributedCommunity::move_nodes()
+{
+    int n = shard.num_owned();
+    double m2 = shard.total_weight;
+    vector<double> candidate_weight, candidate_tot, gains;
+    vector<int> candidate_ids;
+    num_visited = num_moved = 0;
+
+    for (int node = 0; node < n; ++node) {
+        ++num_visited;
+        int community = community_of[node];
+        int own = slot(community);
+
+        nbr_communities.clear();
+        nbr_communities.add(own, 0);
+        for (unsigned long i = shard.first_neighbor(node); i < shard.degrees[node]; ++i) {
+            int neigh = shard.links[i];
+            if (neigh == node)
+                continue;
+            int comm = (neigh < n) ? community_of[neigh] : ghost_community[neigh - n];
+            nbr_communities.add(slot(comm), shard.weights.empty() ? 1 : shard.weights[i]);
+        }
+
+        double degree = shard.weighted_degrees[node];
+        tot[own] -= degree;
+        --members[own];
+
+        // the same choice as Community::move_nodes_sequential, ties going to the smallest id
+        int k = nbr_communities.touched.size();
+        candidate_weight.resize(k);
+        candidate_tot.resize(k);
+        candidate_ids.resize(k);
+        gains.resize(k);
+        for (int c = 0; c < k; ++c) {
+            int s = nbr_communities.touched[c];
+            candidate_weight[c] = nbr_communities.weight[s];
+            candidate_tot[c] = tot[s];
+            candidate_ids[c] = slot_community(s);
+        }
+        int best = best_candidate(candidate_weight.data(), candidate_tot.data(), candidate_ids.data(), k, degree / m2, gains.data());
+        int best_slot = (best < 0) ? own : nbr_communities.touched[best];
+
+        // two singletons on different workers would swap communities forever, only the
+        // move towards the smaller id is allowed
+        if (best_slot >= n && members[own] == 0 && members[best_slot] == 1 && candidate_ids[best] > community)
+            best_slot = own;
+
+        tot[best_slot] += degree;
+        ++members[best_slot];
+        community_of[node] = slot_community(best_slot);
+        if (best_slot != own)
+            ++num_moved;
+    }
+}
+
+void DistributedCommunity::synchronize()
+{
+    int n = shard.num_owned();
+    int num_workers = t.size();
+
+    // changes of the remote communities, applied by their owners
+    vector<vector<CommunityState>> changes(num_workers);
+    for (size_t r = 0; r < remote_communities.size(); ++r) {
+        int comm = remote_communities[r];
+        CommunityState change = { comm, members[n + r] - remote_members_start[r], tot[n + r] - remote_tot_start[r] };
+        if (change.members != 0 || change.tot != 0)
+            changes[shard.owner(comm)].push_back(change);
+    }
+    for (const vector<CommunityState>& received : exchange(t, changes)) {
+        for (const CommunityState& change : received) {
+            tot[change.comm - shard.begin] += change.tot;
+            members[change.comm - shard.begin] += change.members;
+        }
+    }
+
+    // communities of the boundary nodes, in the order of the ghosts of every worker
+    vector<vector<int>> boundary(num_workers);
+    for (int w = 0; w < num_workers; ++w)
+        for (int node : shard.send_lists[w])
+            boundary[w].push_back(community_of[node]);
+    vector<vector<int>> received = exchange(t, boundary);
+    for (int w = 0; w < num_workers; ++w)
+        copy(received[w].begin(), received[w].end(), ghost_community.begin() + shard.ghost_offsets[w]);
+
+    // state of every remote community used here, from its owner
+    remote_communities.clear();
+    remote_slot.clear();
+    auto see = [&](int comm) {
+        if ((comm < shard.begin || comm >= shard.end) && remote_slot.find(comm) == remote_slot.end()) {
+            remote_slot[comm] = n + remote_communities.size();
+            remote_communities.push_back(comm);
+        }
+    };
+    for (int comm : community_of)
+        see(comm);
+    for (int comm : ghost_community)
+        see(comm);
+
+    vector<vector<int>> requests(num_workers);
+    for (int comm : remote_communities)
+        requests[shard.owner(comm)].push_back(comm);
+    vector<vector<int>> asked = exchange(t, requests);
+    vector<vector<CommunityState>> answers(num_workers);
+    for (int w = 0; w < num_workers; ++w)
+        for (int comm : asked[w])
+            answers[w].push_back({ comm, members[comm - shard.begin], tot[comm - shard.begin] });
+
+    int num_slots = n + remote_communities.size();
+    tot.resize(num_slots);
+    members.resize(num_slots);
+    for (const vector<CommunityState>& states : exchange(t, answers)) {
+        for (const CommunityState& state : states) {
+            int s = remote_slot[state.comm];
+            tot[s] = state.tot;
+            members[s] = state.members;
+        }
+    }
+    remote_tot_start.assign(tot.begin() + n, tot.end());
+    remote_members_start.assign(members.begin() + n, members.end());
+    if (nbr_communities.weight.size() < num_slots)
+        nbr_communities.resize(num_slots);
+}
+
+double DistributedCommunity::one_level(double min_modularity)
+{
+    int num_pass_done = 0;
+    double new_mod = modularity();
+    double cur_mod = -1;
+
+    while (new_mod - cur_mod > min_modularity) {
+        cur_mod = new_mod;
+        num_pass_done++;
+        PhaseTimer timer("pass", num_pass_done);
+
+        move_nodes();
+        synchronize();
+
+        new_mod = modularity();
+        double moved = all_reduce_sum(t, num_moved);
+        if (verbose)
+            cerr << "pass number " << num_pass_done << ": " << cur_mod << " ---> " << new_mod
+                 << " (moved " << moved << ")" << endl;
+    }
+    return new_mod;
+}
+
+void DistributedCommunity::aggregate()
+{
+    int n = shard.num_owned();
+    int num_workers = t.size();
+
+    // the non-empty communities owned here are the nodes of this worker on the next level
+    int count = 0;
+    for (int s = 0; s < n; ++s)
+        count += members[s] > 0;
+    vector<int> counts = all_gather(t, count);
+    vector<int> next_starts(num_workers + 1, 0);
+    for (int w = 0; w < num_workers; ++w)
+        next_starts[w + 1] = next_starts[w] + counts[w];
+
+    vector<int> new_id(n + remote_communities.size(), -1);
+    int next_id = next_starts[t.rank()];
+    for (int s = 0; s < n; ++s)
+        if (members[s] > 0)
+            new_id[s] = next_id++;
+
+    // new ids of the remote communities, from their owners
+    vector<vector<int>> requests(num_workers);
+    for (int comm : remote_communities)
+        requests[shard.owner(comm)].push_back(comm);
+    vector<vector<int>> asked = exchange(t, requests);
+    for (vector<int>& ids : asked)
+        for (int& comm : ids)
+            comm = new_id[comm - shard.begin];
+    vector<vector<int>> answers = exchange(t, asked);
+    for (int w = 0; w < num_workers; ++w)
+        for (size_t i = 0; i < requests[w].size(); ++i)
+            new_id[slot(requests[w][i])] = answers[w][i];
+
+    // level node of every node of level 0, asked to the owner of its current level node
+    vector<vector<int>> level_requests(num_workers);
+    for (int node : level_node_of)
+        level_requests[shard.owner(node)].push_back(node);
+    asked = exchange(t, level_requests);
+    for (vector<int>& nodes : asked)
+        for (int& node : nodes)
+            node = new_id[slot(community_of[node - shard.begin])];
+    answers = exchange(t, asked);
+    vector<size_t> cursor(num_workers, 0);
+    for (int& node : level_node_of) {
+        int w = shard.owner(node);
+        node = answers[w][cursor[w]++];
+    }
+
+    // edges between communities, summed here, then sent to the owner of their source
+    vector<vector<ShardEdge>> edges(num_workers);
+    for (int node = 0; node < n; ++node) {
+        int comm = community_of[node];
+        int src = new_id[slot(comm)];
+        vector<ShardEdge>& out = edges[shard.owner(comm)];
+        for (unsigned long i = shard.first_neighbor(node); i < shard.degrees[node]; ++i) {
+            int neigh = shard.links[i];
+            int neigh_comm = (neigh < n) ? community_of[neigh] : ghost_community[neigh - n];
+            out.push_back({ src, new_id[slot(neigh_comm)], shard.weights.empty() ? 1 : shard.weights[i] });
+        }
+    }
+    auto merge = [](vector<ShardEdge>& list) {
+        sort(list.begin(), list.end());
+        size_t last = 0;
+        for (size_t i = 1; i < list.size(); ++i) {
+            if (list[i].src == list[last].src && list[i].dst == list[last].dst)
+                list[last].weight += list[i].weight;
+            else
+                list[++last] = list[i];
+        }
+        if (!list.empty())
+            list.resize(last + 1);
+    };
+    for (vector<ShardEdge>& list : edges)
+        merge(list);
+    vector<ShardEdge> next_edges;
+    for (const vector<ShardEdge>& received : exchange(t, edges))
+        next_edges.insert(next_edges.end(), received.begin(), received.end());
+    merge(next_edges);
+
+    int next_begin = next_starts[t.rank()];
+    vector<unsigned long> degrees(count, 0);
+    vector<int> links(next_edges.size());
+    vector<float> weights(next_edges.size());
+    double weight = 0;
+    for (size_t i = 0; i < next_edges.size(); ++i) {
+        ++degrees[next_edges[i].src - next_begin];
+        links[i] = next_edges[i].dst;
+        weights[i] = next_edges[i].weight;
+        weight += weights[i];
+    }
+    for (int node = 1; node < count; ++node)
+        degrees[node] += degrees[node - 1];
+
+    shard.build(t, next_starts, degrees, links, weights, all_reduce_sum(t, weight));
+    reset_singletons();
+}
+
+void DistributedCommunity::gather_partition(vector<int>& ids, vector<int>& partition)
+{
+    vector<vector<int>> pairs(t.size());
+    for (size_t node = 0; node < level_node_of.size(); ++node) {
+        pairs[0].push_back(original_ids[node]);
+        pairs[0].push_back(level_node_of[node]);
+    }
+    vector<vector<int>> received = exchange(t, pairs);
+    ids.clear();
+    partition.clear();
+    for (const vector<int>& list : received) {
+        for (size_t i = 0; i < list.size(); i += 2) {
+            ids.push_back(list[i]);
+            partition.push_back(list[i + 1]);
+        }
+    }
+}
+
+double distributed_louvain(Transport& t, string filepath, vector<int>& ids, vector<int>& partition, bool verbose)
+{
+    set_stats_level(0);
+    PhaseTimer load_timer("load");
+    DistributedCommunity c(t, filepath);
+    load_timer.stop();
+    c.verbose = verbose && t.rank() == 0;
+
+    double mod = c.modularity();
+    int level = 0;
+    double new_mod;
+    while (true) {
+        // self-loops are stored once, every other edge on both sides
+        double entries = c.shard.links.size();
+        for (int node = 0; node < c.shard.num_owned(); ++node)
+            for (unsigned long i = c.shard.first_neighbor(node); i < c.shard.degrees[node]; ++i)
+                entries += c.shard.links[i] == node;
+        double num_links = all_reduce_sum(t, entries) / 2;
+        if (c.verbose)
+            cerr << "\nnetwork : " << c.shard.num_nodes() << " nodes, " << num_links << " links, "
+                 << c.shard.total_weight << " weight, " << t.size() << " workers" << endl;
+
+        set_stats_level(level);
+        PhaseTimer level_timer("level");
+        new_mod = c.one_level(PRECISION);
+        level_timer.stop();
+        if (c.verbose)
+            cerr << "modularity increased from " << mod << " to " << new_mod << endl;
+
+        PhaseTimer contraction_timer("contraction");
+        c.aggregate();
+        contraction_timer.stop();
+
+        if (new_mod - mod <= PRECISION)
+            break;
+        mod = new_mod;
+        ++level;
+    }
+
+    c.gather_partition(ids, partition);
+    return new_mod;
+}
@@ -0,0 +1,215 @@
+#pragma once
+#include "pipeline.hpp"
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+// distributed Louvain: every worker process owns a contiguous range of the nodes (a shard of
+// the CSR) and ghost copies of the neighbors owned by other workers; workers move their own
+// nodes, exchange the tot deltas of remote communities and the communities of boundary nodes
+// after every pass, and contract the graph together, each keeping the communities it owns
+
+// point-to-point messages between the workers of a run
+// a transport only moves bytes, the collectives below are built on send/recv; the Unix
+// socket stand-in (SocketTransport) runs the workers on one machine, a network transport
+// (MPI, TCP) only has to implement these four methods
+class Transport {
+public:
+    virtual ~Transport() { }
+    virtual int rank() const = 0;
+    virtual int size() const = 0;
+
+    // sends a message to worker to
+    virtual void send(int to, const void* data, size_t bytes) = 0;
+
+    // receives the next message from worker from into data
+    virtual void recv(int from, vector<char>& data) = 0;
+};
+
+// workers forked from the calling process, connected pairwise by Unix socket pairs
+// every process returns from fork_workers with the transport of its rank, 0 in the calling
+// process; rank 0 waits for the other workers when its transport is destroyed
+class SocketTransport : public Transport {
+public:
+    static unique_ptr<SocketTransport> fork_workers(int num_workers);
+
+    ~SocketTransport();
+
+    int rank() const override { return my_rank; }
+    int size() const override { return peers.size(); }
+    void send(int to, const void* data, size_t bytes) override;
+    void recv(int from, vector<char>& data) override;
+
+private:
+    int my_rank;
+    // socket connected to every other worker (-1 for this one)
+    vector<int> peers;
+    vector<pid_t> children;
+};
+
+// all-to-all: outgoing[w] is sent to worker w, the result holds what every worker sent here
+// the messages of one step are sent from another thread while receiving, so two workers
+// sending each other more than a socket buffer do not block
+vector<vector<char>> exchange_bytes(Transport& t, vector<vector<char>>& outgoing);
+
+template <typename T>
+vector<vector<T>> exchange(Transport& t, const vector<vector<T>>& outgoing)
+{
+    vector<vector<char>> bytes(t.size());
+    for (int w = 0; w < t.size(); ++w)
+        bytes[w].assign((const char*)outgoing[w].data(), (const char*)(outgoing[w].data() + outgoing[w].size()));
+    bytes = exchange_bytes(t, bytes);
+    vector<vector<T>> incoming(t.size());
+    for (int w = 0; w < t.size(); ++w)
+        incoming[w].assign((const T*)bytes[w].data(), (const T*)(bytes[w].data() + bytes[w].size()));
+    return incoming;
+}
+
+// value of every worker, by rank
+template <typename T>
+vector<T> all_gather(Transport& t, T value)
+{
+    vector<vector<T>> outgoing(t.size(), vector<T>(1, value));
+    vector<vector<T>> incoming = exchange(t, outgoing);
+    vector<T> values(t.size());
+    for (int w = 0; w < t.size(); ++w)
+        values[w] = incoming[w][0];
+    return values;
+}
+
+// sums in rank order, so that every worker gets the same bits and takes the same decisions
+inline double all_reduce_sum(Transport& t, double value)
+{
+    double sum = 0;
+    for (double v : all_gather(t, value))
+        sum += v;
+    return sum;
+}
+
+// tot and number of members of a community, or their change during a pass
+struct CommunityState {
+    int comm;
+    int members;
+    double tot;
+};
+
+// aggregated edge of the next level, sent to the owner of src
+struct ShardEdge {
+    int src;
+    int dst;
+    double weight;
+
+    bool operator<(const ShardEdge& other) const
+    {
+        return src < other.src || (src == other.src && dst < other.dst);
+    }
+};
+
+// the nodes [begin, end) of a graph and their neighbor lists
+// links are local indices: below num_owned() the owned node begin + index, above it the
+// ghost ghosts[index - num_owned()]; ghosts are sorted by node id, so the ghosts owned by
+// worker w are ghosts[ghost_offsets[w] .. ghost_offsets[w + 1])
+struct Shard {
+    // first node of every worker, starts[size] is the number of nodes of the graph
+    vector<int> starts;
+    int begin, end;
+    double total_weight;
+
+    vector<unsigned long> degrees;
+    vector<int> links;
+    vector<float> weights;
+    vector<int> ghosts;
+    vector<int> ghost_offsets;
+
+    // weighted degree of every owned node
+    vector<double> weighted_degrees;
+
+    // owned nodes ghosted by every worker, as local indices, in the order of its ghosts
+    vector<vector<int>> send_lists;
+
+    // builds the shard of this worker from neighbor lists given with node ids (degrees
+    // cumulative from begin), finds the ghosts and tells their owners who ghosts what
+    void build(Transport& t, vector<int> node_starts, vector<unsigned long> node_degrees,
+        const vector<int>& global_links, vector<float> link_weights, double graph_weight);
+
+    int num_owned() const { return end - begin; }
+    int num_nodes() const { return starts.back(); }
+    int owner(int node) const { return upper_bound(starts.begin(), starts.end(), node) - starts.begin() - 1; }
+    unsigned long first_neighbor(int node) const { return (node == 0) ? 0 : degrees[node - 1]; }
+};
+
+// the Louvain levels of one worker
+class DistributedCommunity {
+public:
+    Transport& t;
+    Shard shard;
+
+    // community (node id) of every owned node and of every ghost
+    vector<int> community_of;
+    vector<int> ghost_community;
+
+    // tot and members of the communities seen here, by slot: slot comm - begin for the
+    // communities owned here (community ids are node ids), the next ones for remote
+    // communities, refreshed from their owners after every pass
+    vector<double> tot;
+    vector<int> members;
+    vector<int> remote_communities;
+    unordered_map<int, int> remote_slot;
+    // state of the remote slots at the start of the pass, to send back the changes
+    vector<double> remote_tot_start;
+    vector<int> remote_members_start;
+
+    // node of the current level of every owned node of level 0
+    vector<int> level_node_of;
+    vector<int> original_ids;
+
+    // nodes examined and nodes moved by the last pass on this worker
+    int num_visited, num_moved;
+    bool verbose;
+
+    NeighborCommunities nbr_communities;
+
+    // maps the shard part of the .bgr file
+    DistributedCommunity(Transport& transport, string filepath);
+
+    // slot of a community seen here
+    int slot(int comm) const
+    {
+        return (comm >= shard.begin && comm < shard.end) ? comm - shard.begin : remote_slot.at(comm);
+    }
+
+    // community of a slot
+    int slot_community(int s) const
+    {
+        return (s < shard.num_owned()) ? shard.begin + s : remote_communities[s - shard.num_owned()];
+    }
+
+    // every node of the shard in its own community
+    void reset_singletons();
+
+    // global modularity of the current partition
+    double modularity();
+
+    // moves every owned node into its best neighboring community, with the state of the
+    // remote communities as of the start of the pass
+    void move_nodes();
+
+    // sends the changes of the remote communities to their owners, then refreshes the
+    // communities of the ghosts and the state of the remote communities they use
+    void synchronize();
+
+    // passes until modularity increases by less than min_modularity
+    double one_level(double min_modularity);
+
+    // contracts the communities into the shard of the next level, every worker keeping the
+    // nodes of the communities it owns, and moves level_node_of to it
+    void aggregate();
+
+    // community of every node of level 0 on worker 0 (in original ids order of the shards)
+    // and their original ids; empty on the other workers
+    void gather_partition(vector<int>& ids, vector<int>& partition);
+};
+
+// runs the levels of the Louvain pipeline over the workers of t on a .bgr file, every worker
+// reading only its shard; returns the modularity, and on worker 0 the original id and the
+// community of every node of the graph
+double distributed_louvain(Transport& t, string filepath, vector<int>& ids, vector<int>& partition, bool verbose);
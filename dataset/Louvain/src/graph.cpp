@@ -1,5 +1,113 @@
 #include "graph.hpp"
 
+MappedFile::MappedFile(string filepath, int advice)
+{
+    data = NULL;
+    size = 0;
+
+    int fd = open(filepath.c_str(), O_RDONLY);
+    assert(fd >= 0);
+    struct stat st;
+    fstat(fd, &st);
+    size = st.st_size;
+    if (size > 0) {
+        void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        assert(p != MAP_FAILED);
+        madvise(p, size, advice);
+        data = (const char*)p;
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data != NULL)
+        munmap((void*)data, size);
+}
+
+// parse an unsigned integer starting at p, leaving p on the first non-digit
+static inline long parse_uint(const char*& p, const char* end)
+{
+    long x = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        x = x * 10 + (*p++ - '0');
+    return x;
+}
+
+static inline bool is_digit(const char* p, const char* end)
+{
+    return p < end && *p >= '0' && *p <= '9';
+}
+
+// parse a non-negative decimal number ("3", "0.25", "1e-3") starting at p
+static inline double parse_weight(const char*& p, const char* end)
+{
+    double x = parse_uint(p, end);
+    if (p < end && *p == '.') {
+        double scale = 0.1;
+        for (++p; is_digit(p, end); ++p, scale /= 10)
+            x += (*p - '0') * scale;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+'))
+            ++p;
+        long exponent = parse_uint(p, end);
+        x *= pow(10.0, negative ? -exponent : exponent);
+    }
+    return x;
+}
+
+// call f(u, v, w) for every "u v [w]" line in [p, end), w is only parsed if weighted (default 1)
+// anything after it on a line is ignored, lines that do not start with two numbers are skipped
+template <typename F>
+static void parse_edges(const char* p, const char* end, bool weighted, F f)
+{
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            ++p;
+        if (is_digit(p, end)) {
+            long u = parse_uint(p, end);
+            while (p < end && (*p == ' ' || *p == '\t'))
+                ++p;
+            if (is_digit(p, end)) {
+                long v = parse_uint(p, end);
+                float w = 1;
+                if (weighted) {
+                    while (p < end && (*p == ' ' || *p == '\t'))
+                        ++p;
+                    if (is_digit(p, end))
+                        w = parse_weight(p, end);
+                }
+                f((int)u, (int)v, w);
+            }
+        }
+        while (p < end && *p != '\n')
+            ++p;
+    }
+}
+
+// split [data, data + size) into about `parts` ranges that start at the beginning of a line
+static vector<pair<const char*, const char*>> split_lines(const char* data, size_t size, int parts)
+{
+    vector<pair<const char*, const char*>> chunks;
+    const char* end = data + size;
+    const char* begin = data;
+    for (int i = 1; i <= parts && begin < end; ++i) {
+        const char* cut = (i == parts) ? end : data + size / parts * i;
+        if (cut < begin)
+            cut = begin;
+        while (cut < end && *cut != '\n')
+            ++cut;
+        if (cut < end)
+            ++cut;
+        chunks.push_back(make_pair(begin, cut));
+        begin = cut;
+    }
+    return chunks;
+}
+
 Graph::Graph()
 {
     num_nodes = 0;
@@ -7,91 +115,1099 @@ Graph::Graph()
     total_weight = 0;
 }
 
-Graph::Graph(string filepath, int type)
+Graph::Graph(string filepath, int type, int nthreads)
 {
     num_nodes = 0;
     num_links = 0;
-    vector<vector<pair<int, float>>> all_links = read_file(filepath);
-    renumber(all_links);
-    num_nodes = all_links.size();
+    total_weight = 0;
+    if (is_binary(filepath)) {
+        read_binary(filepath);
+        compute_node_weights(nthreads);
+    } else if (type == WEIGHTED) {
+        read_file(filepath, nthreads, true);
+        merge_duplicates(nthreads);
+        compute_node_weights(nthreads);
 
-    // cumulative degree sequence
+        // self-loops count once, as in the weighted degrees
+        for (int node = 0; node < num_nodes; ++node)
+            total_weight += node_weighted_degrees[node];
+    } else {
+        read_file(filepath, nthreads);
+
+        // weights
+        total_weight = 2 * num_links;
+        compute_node_weights(nthreads);
+    }
+}
+
+static size_t align8(size_t bytes)
+{
+    return (bytes + 7) & ~(size_t)7;
+}
+
+bool Graph::is_binary(string filepath)
+{
+    char magic[8] = { 0 };
+    ifstream finput(filepath, ios::binary);
+    finput.read(magic, sizeof(magic));
+    return finput.gcount() == sizeof(magic) && memcmp(magic, BINARY_GRAPH_MAGIC, sizeof(magic)) == 0;
+}
+
+void Graph::read_binary(string filepath)
+{
+    static_assert(sizeof(unsigned long) == sizeof(uint64_t), "degrees are stored as uint64");
+
+    shared_ptr<MappedFile> file = make_shared<MappedFile>(filepath, MADV_NORMAL);
+    assert(file->size >= sizeof(BinaryGraphHeader));
+    const BinaryGraphHeader* header = (const BinaryGraphHeader*)file->data;
+    assert(memcmp(header->magic, BINARY_GRAPH_MAGIC, sizeof(header->magic)) == 0);
+    assert(header->version == BINARY_GRAPH_VERSION);
+
+    num_nodes = header->num_nodes;
+    num_links = header->num_links;
+    total_weight = header->total_weight;
+    size_t num_entries = header->num_entries;
+
+    size_t offset = sizeof(BinaryGraphHeader);
+    degrees.view((const unsigned long*)(file->data + offset), num_nodes, file);
+    offset += align8(num_nodes * sizeof(uint64_t));
+    links.view((const int*)(file->data + offset), num_entries, file);
+    offset += align8(num_entries * sizeof(int));
+    if (header->flags & BINARY_GRAPH_WEIGHTS) {
+        weights.view((const float*)(file->data + offset), num_entries, file);
+        offset += align8(num_entries * sizeof(float));
+    }
+    if (header->flags & BINARY_GRAPH_ORIGINAL_IDS) {
+        node_id_to_original_id.view((const int*)(file->data + offset), num_nodes, file);
+        offset += align8(num_nodes * sizeof(int));
+    } else {
+        node_id_to_original_id.resize(num_nodes);
+        for (int node = 0; node < num_nodes; ++node)
+            node_id_to_original_id[node] = node;
+    }
+
+    int max_id = -1;
+    for (int node = 0; node < num_nodes; ++node)
+        max_id = max(max_id, node_id_to_original_id[node]);
+    original_id_to_node_id.assign(max_id + 1, -1);
+    for (int node = 0; node < num_nodes; ++node)
+        original_id_to_node_id[node_id_to_original_id[node]] = node;
+    assert(offset <= file->size);
+}
+
+BinaryGraphHeader Graph::read_binary_shard(string filepath, int parts, int part, vector<int>& starts,
+    vector<unsigned long>& degrees, vector<int>& links, vector<float>& weights, vector<int>& original_ids)
+{
+    MappedFile file(filepath, MADV_RANDOM);
+    assert(file.size >= sizeof(BinaryGraphHeader));
+    BinaryGraphHeader header = *(const BinaryGraphHeader*)file.data;
+    assert(memcmp(header.magic, BINARY_GRAPH_MAGIC, sizeof(header.magic)) == 0);
+    assert(header.version == BINARY_GRAPH_VERSION);
+
+    int num_nodes = header.num_nodes;
+    size_t num_entries = header.num_entries;
+    const unsigned long* all_degrees = (const unsigned long*)(file.data + sizeof(BinaryGraphHeader));
+    size_t links_offset = sizeof(BinaryGraphHeader) + align8(num_nodes * sizeof(uint64_t));
+    size_t weights_offset = links_offset + align8(num_entries * sizeof(int));
+    size_t ids_offset = weights_offset + ((header.flags & BINARY_GRAPH_WEIGHTS) ? align8(num_entries * sizeof(float)) : 0);
+
+    // shard k starts at the first node whose neighbors end past k / parts of the entries
+    starts.assign(parts + 1, num_nodes);
+    starts[0] = 0;
+    for (int k = 1; k < parts; ++k) {
+        unsigned long target = num_entries * k / parts;
+        starts[k] = upper_bound(all_degrees, all_degrees + num_nodes, target) - all_degrees;
+        starts[k] = max(starts[k], starts[k - 1]);
+    }
+
+    int first = starts[part];
+    int last = starts[part + 1];
+    unsigned long first_entry = (first == 0) ? 0 : all_degrees[first - 1];
+    unsigned long last_entry = (last == 0) ? 0 : all_degrees[last - 1];
+    degrees.resize(last - first);
+    for (int node = first; node < last; ++node)
+        degrees[node - first] = all_degrees[node] - first_entry;
+    const int* all_links = (const int*)(file.data + links_offset);
+    links.assign(all_links + first_entry, all_links + last_entry);
+    weights.clear();
+    if (header.flags & BINARY_GRAPH_WEIGHTS) {
+        const float* all_weights = (const float*)(file.data + weights_offset);
+        weights.assign(all_weights + first_entry, all_weights + last_entry);
+    }
+    original_ids.resize(last - first);
+    for (int node = first; node < last; ++node)
+        original_ids[node - first] = node;
+    if (header.flags & BINARY_GRAPH_ORIGINAL_IDS) {
+        const int* all_ids = (const int*)(file.data + ids_offset);
+        original_ids.assign(all_ids + first, all_ids + last);
+    }
+    return header;
+}
+
+// b shares the elements of a: a view of a view keeps what keeps the first one alive
+template <typename T>
+static void share(const Buffer<T>& a, Buffer<T>& b)
+{
+    if (a.is_view())
+        b = a;
+    else
+        b.view(a.data(), a.size(), NULL);
+}
+
+Graph Graph::view() const
+{
+    Graph g;
+    g.num_nodes = num_nodes;
+    g.num_links = num_links;
+    g.total_weight = total_weight;
+    share(degrees, g.degrees);
+    share(links, g.links);
+    share(weights, g.weights);
+    share(node_weighted_degrees, g.node_weighted_degrees);
+    share(node_selfloops, g.node_selfloops);
+    share(node_id_to_original_id, g.node_id_to_original_id);
+    return g;
+}
+
+bool Graph::is_view() const
+{
+    return degrees.is_view() || links.is_view() || weights.is_view() || node_weighted_degrees.is_view()
+        || node_selfloops.is_view() || node_id_to_original_id.is_view();
+}
+
+Graph Graph::from_csr(int num_nodes, const unsigned long* degrees, const int* links, const float* weights,
+    const int* original_ids, int nthreads)
+{
+    Graph g;
+    g.num_nodes = num_nodes;
+    size_t num_entries = (num_nodes == 0) ? 0 : degrees[num_nodes - 1];
+    g.degrees.view(degrees, num_nodes, NULL);
+    g.links.view(links, num_entries, NULL);
+    if (weights != NULL)
+        g.weights.view(weights, num_entries, NULL);
+    if (original_ids != NULL) {
+        g.node_id_to_original_id.view(original_ids, num_nodes, NULL);
+    } else {
+        g.node_id_to_original_id.resize(num_nodes);
+        for (int node = 0; node < num_nodes; ++node)
+            g.node_id_to_original_id[node] = node;
+    }
+
+    int max_id = -1;
+    for (int node = 0; node < num_nodes; ++node)
+        max_id = max(max_id, g.node_id_to_original_id[node]);
+    g.original_id_to_node_id.assign(max_id + 1, -1);
+    for (int node = 0; node < num_nodes; ++node)
+        g.original_id_to_node_id[g.node_id_to_original_id[node]] = node;
+
+    g.compute_node_weights(nthreads);
+
+    // self-loops are stored once, every other edge twice
+    unsigned long selfloops = 0;
+    for (int node = 0; node < num_nodes; ++node) {
+        pair<unsigned long, unsigned long> indices = g.neighbors(node);
+        for (int i = 0; i < g.num_neighbors(node); ++i)
+            selfloops += (links[indices.first + i] == node);
+    }
+    g.num_links = (num_entries + selfloops) / 2;
+    if (weights == NULL) {
+        g.total_weight = 2 * g.num_links;
+    } else {
+        g.total_weight = 0;
+        for (int node = 0; node < num_nodes; ++node)
+            g.total_weight += g.node_weighted_degrees[node];
+    }
+    return g;
+}
+
+static BinaryGraphHeader binary_header(const Graph& g, bool weighted, size_t num_entries)
+{
+    BinaryGraphHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_GRAPH_MAGIC, sizeof(header.magic));
+    header.version = BINARY_GRAPH_VERSION;
+    header.flags = BINARY_GRAPH_ORIGINAL_IDS | (weighted ? BINARY_GRAPH_WEIGHTS : 0);
+    header.num_nodes = g.num_nodes;
+    header.num_links = g.num_links;
+    header.num_entries = num_entries;
+    header.total_weight = g.total_weight;
+    return header;
+}
+
+static void write_padding(ofstream& output, size_t bytes)
+{
+    const char padding[8] = { 0 };
+    output.write(padding, align8(bytes) - bytes);
+}
+
+void Graph::write_binary(string filepath)
+{
+    BinaryGraphHeader header = binary_header(*this, weights.size() != 0, links.size());
+
+    // the arrays may still view the mapping of filepath itself (louvain g.bgr -u batch -w g.bgr),
+    // so the file is written next to it and renamed over it once complete
+    string temporary_path = filepath + ".tmp";
+    ofstream output(temporary_path, ios::binary);
+    assert(output.good());
+    auto write_array = [&](const void* data, size_t bytes) {
+        output.write((const char*)data, bytes);
+        write_padding(output, bytes);
+    };
+    output.write((const char*)&header, sizeof(header));
+    write_array(degrees.data(), num_nodes * sizeof(uint64_t));
+    write_array(links.data(), links.size() * sizeof(int));
+    if (weights.size() != 0)
+        write_array(weights.data(), weights.size() * sizeof(float));
+    write_array(node_id_to_original_id.data(), num_nodes * sizeof(int));
+    output.close();
+    assert(!output.fail());
+    int renamed = rename(temporary_path.c_str(), filepath.c_str());
+    assert(renamed == 0);
+}
+
+// one entry of the adjacency, as spilled to the sorted runs of build_binary
+// duplicates of a weighted edge come out in increasing weight, and are summed in the same
+// order as merge_duplicates does
+struct RunEntry {
+    int node;
+    int neigh;
+    float weight;
+
+    bool operator<(const RunEntry& other) const
+    {
+        if (node != other.node)
+            return node < other.node;
+        if (neigh != other.neigh)
+            return neigh < other.neigh;
+        return weight < other.weight;
+    }
+};
+
+// smallest read buffer of a run in the merge; the runs merged at once (fan-in) are
+// capped so that their buffers fit in the memory budget
+#define RUN_BUFFER_ENTRIES 4096
+
+// buffered sequential reader of a sorted run
+class RunReader {
+public:
+    RunReader(string filepath, size_t buffer_entries)
+        : input(filepath, ios::binary)
+        , buffer(buffer_entries)
+        , position(0)
+        , count(0)
+    {
+        assert(input.good());
+    }
+
+    // false once the run is exhausted
+    bool next(RunEntry& entry)
+    {
+        if (position == count) {
+            input.read((char*)buffer.data(), buffer.size() * sizeof(RunEntry));
+            count = input.gcount() / sizeof(RunEntry);
+            position = 0;
+            if (count == 0)
+                return false;
+        }
+        entry = buffer[position++];
+        return true;
+    }
+
+private:
+    ifstream input;
+    vector<RunEntry> buffer;
+    size_t position;
+    size_t count;
+};
+
+void Graph::build_binary(string input_path, string output_path, size_t memory_bytes, int nthreads, bool weighted)
+{
+    size_t capacity = max(memory_bytes / sizeof(RunEntry), (size_t)1024);
+    vector<RunEntry> entries;
+    entries.reserve(capacity);
+    vector<string> run_paths;
+    vector<unsigned long> counts;
+    Graph g;
+
+    // sorts the entries in nthreads slices and spills every slice as a run
+    auto spill = [&]() {
+        int parts = min((size_t)nthreads, (entries.size() + 1023) / 1024);
+        int first_run = run_paths.size();
+        for (int part = 0; part < parts; ++part)
+            run_paths.push_back(output_path + ".run" + to_string(run_paths.size()));
+        parallel_for(parts, 0, parts, [&](long part, int) {
+            size_t begin = entries.size() * part / parts;
+            size_t end = entries.size() * (part + 1) / parts;
+            sort(entries.begin() + begin, entries.begin() + end);
+            ofstream run(run_paths[first_run + part], ios::binary);
+            assert(run.good());
+            run.write((const char*)(entries.data() + begin), (end - begin) * sizeof(RunEntry));
+            assert(run.good());
+        }, 1);
+        entries.clear();
+    };
+
+    // pass 1: both sides of every edge into sorted runs, counting degrees on the way
+    {
+        MappedFile file(input_path);
+        parse_edges(file.data, file.data + file.size, weighted, [&](int u, int v, float w) {
+            if (max(u, v) >= (int)counts.size())
+                counts.resize(max(u, v) + 1, 0);
+            ++g.num_links;
+            ++counts[u];
+            entries.push_back({ u, v, w });
+            if (u != v) {
+                ++counts[v];
+                entries.push_back({ v, u, w });
+            }
+            if (entries.size() + 2 > capacity)
+                spill();
+        });
+        if (!entries.empty())
+            spill();
+    }
+    vector<RunEntry>().swap(entries);
+
+    g.total_weight = 2 * g.num_links;
+    g.renumber(counts);
+    vector<unsigned long>().swap(counts);
+    size_t num_entries = g.num_nodes == 0 ? 0 : g.degrees[g.num_nodes - 1];
+
+    // weighted: the counts include the duplicates, the header and the degrees are written
+    // again once the merge has summed them
+    ofstream output(output_path, ios::binary);
+    assert(output.good());
+    BinaryGraphHeader header = binary_header(g, weighted, num_entries);
+    output.write((const char*)&header, sizeof(header));
+    output.write((const char*)g.degrees.data(), g.num_nodes * sizeof(uint64_t));
+    write_padding(output, g.num_nodes * sizeof(uint64_t));
+
+    // pass 2: k-way merge of the runs, written out as links
+    // renumbering keeps the order of the ids, so the merged order is the CSR order
+    // at most fan_in runs are open at once: half of the memory for their read buffers (the
+    // other half for the output buffer) and a file descriptor each; with more runs, groups
+    // of fan_in runs are first merged into longer runs, pass after pass
+    struct rlimit files;
+    size_t max_open = 64;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur != RLIM_INFINITY)
+        max_open = files.rlim_cur;
+    size_t fan_in = min(memory_bytes / (2 * RUN_BUFFER_ENTRIES * sizeof(RunEntry)), max_open > 18 ? max_open - 16 : 2);
+    fan_in = max(fan_in, (size_t)2);
+
+    // merges the runs [first, last) of run_paths in order, calling emit on every entry, then
+    // removes them; buffer_entries receives the size of the read buffers, which emit also
+    // uses for its output buffer
+    auto merge = [&](size_t first, size_t last, size_t& buffer_entries, auto emit) {
+        size_t num_runs = last - first;
+        buffer_entries = max(memory_bytes / sizeof(RunEntry) / (2 * max(num_runs, (size_t)1)), (size_t)RUN_BUFFER_ENTRIES);
+        vector<unique_ptr<RunReader>> readers;
+        for (size_t run = first; run < last; ++run)
+            readers.emplace_back(new RunReader(run_paths[run], buffer_entries));
+
+        typedef pair<RunEntry, int> Head;
+        auto later = [](const Head& a, const Head& b) { return b.first < a.first; };
+        priority_queue<Head, vector<Head>, decltype(later)> heads(later);
+        for (int run = 0; run < (int)readers.size(); ++run) {
+            RunEntry entry;
+            if (readers[run]->next(entry))
+                heads.push(make_pair(entry, run));
+        }
+        while (!heads.empty()) {
+            Head head = heads.top();
+            heads.pop();
+            emit(head.first);
+            RunEntry entry;
+            if (readers[head.second]->next(entry))
+                heads.push(make_pair(entry, head.second));
+        }
+        readers.clear();
+        for (size_t run = first; run < last; ++run)
+            remove(run_paths[run].c_str());
+    };
+
+    size_t next_run = 0;
+    while (run_paths.size() - next_run > fan_in) {
+        size_t last = next_run + fan_in;
+        string merged_path = output_path + ".run" + to_string(run_paths.size());
+        ofstream merged(merged_path, ios::binary);
+        assert(merged.good());
+        vector<RunEntry> buffer;
+        size_t buffer_entries;
+        merge(next_run, last, buffer_entries, [&](const RunEntry& entry) {
+            if (buffer.empty())
+                buffer.reserve(buffer_entries);
+            buffer.push_back(entry);
+            if (buffer.size() == buffer_entries) {
+                merged.write((const char*)buffer.data(), buffer.size() * sizeof(RunEntry));
+                buffer.clear();
+            }
+        });
+        merged.write((const char*)buffer.data(), buffer.size() * sizeof(RunEntry));
+        assert(merged.good());
+        run_paths.push_back(merged_path);
+        next_run = last;
+    }
+
+    // weighted: the weights go to a spill file until the number of links is known, and
+    // the merged degree of every node is counted
+    vector<int> out;
+    vector<float> out_weights;
+    string weights_path = output_path + ".weights";
+    ofstream weights_output;
+    vector<unsigned long> merged_degrees;
+    unsigned long num_selfloops = 0;
+    if (weighted) {
+        weights_output.open(weights_path, ios::binary);
+        assert(weights_output.good());
+        merged_degrees.assign(g.num_nodes, 0);
+        g.total_weight = 0;
+    }
+    size_t written = 0;
+    size_t buffer_entries;
+    auto flush = [&]() {
+        output.write((const char*)out.data(), out.size() * sizeof(int));
+        written += out.size();
+        out.clear();
+        if (weighted) {
+            weights_output.write((const char*)out_weights.data(), out_weights.size() * sizeof(float));
+            out_weights.clear();
+        }
+    };
+    // weighted degree of the current node, summed like compute_node_weights does
+    int current_node = -1;
+    double node_weight = 0;
+    auto write_entry = [&](const RunEntry& entry) {
+        if (out.size() == buffer_entries)
+            flush();
+        if (out.empty())
+            out.reserve(buffer_entries);
+        out.push_back(g.original_id_to_node_id[entry.neigh]);
+        if (!weighted)
+            return;
+        int node = g.original_id_to_node_id[entry.node];
+        out_weights.push_back(entry.weight);
+        ++merged_degrees[node];
+        num_selfloops += entry.node == entry.neigh;
+        if (node != current_node) {
+            g.total_weight += node_weight;
+            node_weight = 0;
+            current_node = node;
+        }
+        node_weight += entry.weight;
+    };
+    // weighted: an edge is written once all its duplicates have been summed into it
+    RunEntry pending = { -1, -1, 0 };
+    merge(next_run, run_paths.size(), buffer_entries, [&](const RunEntry& entry) {
+        if (!weighted) {
+            write_entry(entry);
+            return;
+        }
+        if (entry.node == pending.node && entry.neigh == pending.neigh) {
+            pending.weight += entry.weight;
+            return;
+        }
+        if (pending.node >= 0)
+            write_entry(pending);
+        pending = entry;
+    });
+    if (pending.node >= 0)
+        write_entry(pending);
+    g.total_weight += node_weight;
+    flush();
+    if (!weighted)
+        assert(written == num_entries);
+    num_entries = written;
+    write_padding(output, num_entries * sizeof(int));
+
+    if (weighted) {
+        weights_output.close();
+        assert(!weights_output.fail());
+        ifstream weights_input(weights_path, ios::binary);
+        assert(weights_input.good());
+        vector<char> chunk(buffer_entries * sizeof(float));
+        while (weights_input.read(chunk.data(), chunk.size()) || weights_input.gcount() > 0)
+            output.write(chunk.data(), weights_input.gcount());
+        weights_input.close();
+        remove(weights_path.c_str());
+        write_padding(output, num_entries * sizeof(float));
+
+        // every edge is stored on both sides, except self-loops
+        g.num_links = (num_entries + num_selfloops) / 2;
+        unsigned long cumulative = 0;
+        for (int node = 0; node < g.num_nodes; ++node) {
+            cumulative += merged_degrees[node];
+            g.degrees[node] = cumulative;
+        }
+    }
+
+    output.write((const char*)g.node_id_to_original_id.data(), g.num_nodes * sizeof(int));
+    write_padding(output, g.num_nodes * sizeof(int));
+    if (weighted) {
+        header = binary_header(g, true, num_entries);
+        output.seekp(0);
+        output.write((const char*)&header, sizeof(header));
+        output.write((const char*)g.degrees.data(), g.num_nodes * sizeof(uint64_t));
+    }
+    assert(output.good());
+}
+
+void Graph::read_file(string filepath, int nthreads, bool weighted)
+{
+    MappedFile file(filepath);
+    vector<pair<const char*, const char*>> chunks = split_lines(file.data, file.size, nthreads * 8);
+    int num_chunks = chunks.size();
+
+    // pass 1: largest id and number of edges
+    vector<long> max_id_of_thread(nthreads, -1);
+    vector<unsigned long> edges_of_thread(nthreads, 0);
+    parallel_for(nthreads, 0, num_chunks, [&](long chunk, int thread_id) {
+        long max_id = max_id_of_thread[thread_id];
+        unsigned long edges = 0;
+        parse_edges(chunks[chunk].first, chunks[chunk].second, false, [&](int u, int v, float) {
+            max_id = max(max_id, (long)max(u, v));
+            ++edges;
+        });
+        max_id_of_thread[thread_id] = max_id;
+        edges_of_thread[thread_id] += edges;
+    }, 1);
+
+    long max_id = -1;
+    for (int t = 0; t < nthreads; ++t) {
+        max_id = max(max_id, max_id_of_thread[t]);
+        num_links += edges_of_thread[t];
+    }
+
+    // pass 2: degree of every id
+    vector<unsigned long> counts(max_id + 1, 0);
+    parallel_for(nthreads, 0, num_chunks, [&](long chunk, int) {
+        parse_edges(chunks[chunk].first, chunks[chunk].second, false, [&](int u, int v, float) {
+            __atomic_fetch_add(&counts[u], 1, __ATOMIC_RELAXED);
+            if (u != v)
+                __atomic_fetch_add(&counts[v], 1, __ATOMIC_RELAXED);
+        });
+    }, 1);
+
+    renumber(counts);
+    const vector<int>& renum = original_id_to_node_id;
+
+    // pass 3: scatter the links (and weights), counts now holds the next free slot of every node
+    links.resize(num_nodes == 0 ? 0 : degrees[num_nodes - 1]);
+    if (weighted)
+        weights.resize(links.size());
+    for (int node = 0; node < num_nodes; ++node)
+        counts[node] = (node == 0) ? 0 : degrees[node - 1];
+    parallel_for(nthreads, 0, num_chunks, [&](long chunk, int) {
+        parse_edges(chunks[chunk].first, chunks[chunk].second, weighted, [&](int u, int v, float w) {
+            int ru = renum[u];
+            int rv = renum[v];
+            unsigned long slot = __atomic_fetch_add(&counts[ru], 1, __ATOMIC_RELAXED);
+            links[slot] = rv;
+            if (weighted)
+                weights[slot] = w;
+            if (u != v) {
+                slot = __atomic_fetch_add(&counts[rv], 1, __ATOMIC_RELAXED);
+                links[slot] = ru;
+                if (weighted)
+                    weights[slot] = w;
+            }
+        });
+    }, 1);
+}
+
+void Graph::merge_duplicates(int nthreads)
+{
+    bool weighted = weights.size() != 0;
+    vector<unsigned long> new_degrees(num_nodes);
+    vector<vector<pair<int, float>>> neighbors_of_thread(nthreads);
+
+    // sort the neighbors of every node and merge them in place, at the start of its range
+    parallel_for(nthreads, 0, num_nodes, [&](long node, int thread_id) {
+        vector<pair<int, float>>& sorted = neighbors_of_thread[thread_id];
+        unsigned long first = neighbors(node).first;
+        int deg = num_neighbors(node);
+        sorted.resize(deg);
+        for (int i = 0; i < deg; ++i)
+            sorted[i] = make_pair(links[first + i], weighted ? weights[first + i] : 1.0f);
+        sort(sorted.begin(), sorted.end());
+
+        unsigned long out = first;
+        for (int i = 0; i < deg; ++i) {
+            if (out > first && links[out - 1] == sorted[i].first) {
+                if (weighted)
+                    weights[out - 1] += sorted[i].second;
+                continue;
+            }
+            links[out] = sorted[i].first;
+            if (weighted)
+                weights[out] = sorted[i].second;
+            ++out;
+        }
+        new_degrees[node] = out - first;
+    }, 1024);
+
+    Buffer<unsigned long> cumulative_degrees;
+    cumulative_degrees.resize(num_nodes);
     unsigned long cumulative = 0;
-    for (int i = 0; i < all_links.size(); ++i) {
-        cumulative += all_links[i].size();
-        degrees.push_back(cumulative);
+    unsigned long num_selfloops = 0;
+    for (int node = 0; node < num_nodes; ++node) {
+        cumulative += new_degrees[node];
+        cumulative_degrees[node] = cumulative;
     }
 
-    // links
-    for (int i = 0; i < all_links.size(); ++i)
-        for (int j = 0; j < all_links[i].size(); ++j)
-            links.push_back(all_links[i][j].first);
+    Buffer<int> new_links;
+    Buffer<float> new_weights;
+    new_links.resize(cumulative);
+    if (weighted)
+        new_weights.resize(cumulative);
+    vector<unsigned long> selfloops_of_thread(nthreads, 0);
+    parallel_for(nthreads, 0, num_nodes, [&](long node, int thread_id) {
+        unsigned long first = neighbors(node).first;
+        unsigned long out = cumulative_degrees[node] - new_degrees[node];
+        for (unsigned long i = 0; i < new_degrees[node]; ++i) {
+            new_links[out + i] = links[first + i];
+            if (weighted)
+                new_weights[out + i] = weights[first + i];
+            if (links[first + i] == node)
+                ++selfloops_of_thread[thread_id];
+        }
+    }, 1024);
+    for (int t = 0; t < nthreads; ++t)
+        num_selfloops += selfloops_of_thread[t];
 
-    // weights
-    total_weight = 2 * num_links;
+    // every edge is stored on both sides, except self-loops
+    num_links = (cumulative + num_selfloops) / 2;
+    degrees = move(cumulative_degrees);
+    links = move(new_links);
+    weights = move(new_weights);
 }
 
-vector<vector<pair<int, float>>> Graph::read_file(string filepath)
+void Graph::renumber(vector<unsigned long>& counts)
+{
+    PhaseTimer timer("renumber");
+    original_id_to_node_id.assign(counts.size(), -1);
+    int nb = 0;
+
+    for (int i = 0; i < counts.size(); ++i)
+        if (counts[i] > 0)
+            original_id_to_node_id[i] = nb++;
+    num_nodes = nb;
+
+    node_id_to_original_id.resize(num_nodes);
+    degrees.resize(num_nodes);
+
+    // cumulative degree sequence
+    unsigned long cumulative = 0;
+    for (int i = 0; i < counts.size(); ++i) {
+        int node = original_id_to_node_id[i];
+        if (node < 0)
+            continue;
+        node_id_to_original_id[node] = i;
+        cumulative += counts[i];
+        degrees[node] = cumulative;
+    }
+}
+
+// one side of an edge update, kept with the node it changes
+struct EdgeChange {
+    int node;
+    int neigh;
+    float weight;
+    // -1 for an insertion, otherwise the index in links of the deleted entry once found
+    long position;
+};
+
+#define EDGE_INSERTION -1
+#define EDGE_NOT_FOUND -2
+
+void Graph::apply_updates(string filepath, vector<int>& touched, int nthreads)
 {
     ifstream finput(filepath);
     assert(finput.good());
 
-    // read from file
-    vector<vector<pair<int, float>>> all_links;
-    int u, v;
-    while (finput >> u >> v) {
-        if (all_links.size() <= max(u, v) + 1)
-            all_links.resize(max(u, v) + 1);
+    int old_num_nodes = num_nodes;
+    auto node_of = [&](int original) {
+        if (original >= (int)original_id_to_node_id.size())
+            original_id_to_node_id.resize(original + 1, -1);
+        if (original_id_to_node_id[original] < 0) {
+            original_id_to_node_id[original] = num_nodes++;
+            node_id_to_original_id.resize(num_nodes);
+            node_id_to_original_id[num_nodes - 1] = original;
+        }
+        return original_id_to_node_id[original];
+    };
+    auto known = [&](int original) {
+        return original < (int)original_id_to_node_id.size() && original_id_to_node_id[original] >= 0;
+    };
+
+    // both sides of every update
+    vector<EdgeChange> changes;
+    bool weighted = weights.size() != 0;
+    string line;
+    while (getline(finput, line)) {
+        istringstream fields(line);
+        char op;
+        int u, v;
+        float w = 1;
+        if (!(fields >> op >> u >> v))
+            continue;
+        fields >> w;
+        if (op == '+') {
+            int nu = node_of(u), nv = node_of(v);
+            weighted = weighted || w != 1;
+            changes.push_back({ nu, nv, w, EDGE_INSERTION });
+            if (nu != nv)
+                changes.push_back({ nv, nu, w, EDGE_INSERTION });
+        } else if (op == '-' && known(u) && known(v)) {
+            int nu = node_of(u), nv = node_of(v);
+            changes.push_back({ nu, nv, 0, EDGE_NOT_FOUND });
+            if (nu != nv)
+                changes.push_back({ nv, nu, 0, EDGE_NOT_FOUND });
+        }
+    }
+
+    // group the changes by node, keeping their order
+    vector<int> change_offsets(num_nodes + 1, 0);
+    for (const EdgeChange& change : changes)
+        ++change_offsets[change.node + 1];
+    for (int node = 0; node < num_nodes; ++node)
+        change_offsets[node + 1] += change_offsets[node];
+    vector<EdgeChange> sorted_changes(changes.size());
+    vector<int> where(change_offsets.begin(), change_offsets.end() - 1);
+    for (const EdgeChange& change : changes)
+        sorted_changes[where[change.node]++] = change;
+    changes.swap(sorted_changes);
 
-        all_links[u].push_back(make_pair(v, 1));
-        if (u != v)
-            all_links[v].push_back(make_pair(u, 1));
-        ++num_links;
+    // find the entry removed by every deletion and the new degree of every node
+    vector<unsigned long> new_degrees(num_nodes);
+    parallel_for(nthreads, 0, num_nodes, [&](long node, int) {
+        unsigned long first = 0, last = 0;
+        if (node < old_num_nodes) {
+            first = neighbors(node).first;
+            last = first + num_neighbors(node);
+        }
+        unsigned long deg = last - first;
+        for (int k = change_offsets[node]; k < change_offsets[node + 1]; ++k) {
+            EdgeChange& change = changes[k];
+            if (change.position == EDGE_INSERTION) {
+                ++deg;
+                continue;
+            }
+            for (unsigned long i = first; i < last; ++i) {
+                if (links[i] != change.neigh)
+                    continue;
+                bool taken = false;
+                for (int j = change_offsets[node]; j < k; ++j)
+                    taken = taken || changes[j].position == (long)i;
+                if (!taken) {
+                    change.position = i;
+                    change.weight = weighted && weights.size() != 0 ? weights[i] : 1;
+                    --deg;
+                    break;
+                }
+            }
+        }
+        new_degrees[node] = deg;
+    }, 4096);
+
+    // cumulative degree sequence of the new graph
+    Buffer<unsigned long> cumulative_degrees;
+    cumulative_degrees.resize(num_nodes);
+    unsigned long cumulative = 0;
+    for (int node = 0; node < num_nodes; ++node) {
+        cumulative += new_degrees[node];
+        cumulative_degrees[node] = cumulative;
+    }
+
+    Buffer<int> new_links;
+    Buffer<float> new_weights;
+    new_links.resize(cumulative);
+    if (weighted)
+        new_weights.resize(cumulative);
+
+    parallel_for(nthreads, 0, num_nodes, [&](long node, int) {
+        unsigned long out = cumulative_degrees[node] - new_degrees[node];
+        if (node < old_num_nodes) {
+            pair<unsigned long, unsigned long> indices = neighbors(node);
+            unsigned long first = indices.first;
+            unsigned long last = first + num_neighbors(node);
+            for (unsigned long i = first; i < last; ++i) {
+                bool deleted = false;
+                for (int k = change_offsets[node]; k < change_offsets[node + 1]; ++k)
+                    deleted = deleted || changes[k].position == (long)i;
+                if (deleted)
+                    continue;
+                new_links[out] = links[i];
+                if (weighted)
+                    new_weights[out] = (weights.size() == 0) ? 1 : weights[i];
+                ++out;
+            }
+        }
+        for (int k = change_offsets[node]; k < change_offsets[node + 1]; ++k) {
+            if (changes[k].position != EDGE_INSERTION)
+                continue;
+            new_links[out] = changes[k].neigh;
+            if (weighted)
+                new_weights[out] = changes[k].weight;
+            ++out;
+        }
+    }, 4096);
+
+    // edges are counted once, on the side of their first endpoint (or their only one for self-loops)
+    // a self-loop is a single entry, so it changes total_weight (the sum of the weighted
+    // degrees) by its weight once, other edges by twice their weight
+    for (const EdgeChange& change : changes) {
+        if (change.position == EDGE_NOT_FOUND || change.node > change.neigh)
+            continue;
+        bool insertion = change.position == EDGE_INSERTION;
+        num_links += insertion ? 1 : -1;
+        total_weight += (insertion ? 1 : -1) * (change.node == change.neigh ? 1 : 2) * change.weight;
     }
-    finput.close();
 
-    return all_links;
+    touched.clear();
+    for (int node = 0; node < num_nodes; ++node)
+        if (change_offsets[node + 1] > change_offsets[node])
+            touched.push_back(node);
+
+    degrees = move(cumulative_degrees);
+    links = move(new_links);
+    weights = move(new_weights);
+    compute_node_weights(nthreads);
 }
 
-void Graph::renumber(vector<vector<pair<int, float>>>& all_links)
+void Graph::compute_node_weights(int nthreads)
 {
-    vector<bool> linked(all_links.size(), false);
-    vector<int> renum(all_links.size(), -1);
-    int nb = 0;
+    node_weighted_degrees.resize(num_nodes);
+    node_selfloops.resize(num_nodes);
 
-    for (int i = 0; i < all_links.size(); ++i) {
-        for (int j = 0; j < all_links[i].size(); j++) {
-            linked[i] = true;
-            linked[all_links[i][j].first] = true;
+    parallel_for(nthreads, 0, num_nodes, [&](long node, int) {
+        pair<unsigned long, unsigned long> indices = neighbors(node);
+        int deg = num_neighbors(node);
+        double weighted_degree = 0;
+        double selfloops = 0;
+        for (int i = 0; i < deg; ++i) {
+            double w = (weights.size() == 0) ? 1 : weights[indices.second + i];
+            weighted_degree += w;
+            if (links[indices.first + i] == node)
+                selfloops += w;
         }
+        node_weighted_degrees[node] = weighted_degree;
+        node_selfloops[node] = selfloops;
+    }, 4096);
+}
+
+void Graph::permute(const vector<int>& order, int nthreads)
+{
+    assert(order.size() == num_nodes);
+    bool weighted = weights.size() != 0;
+    vector<int> new_id_of(num_nodes);
+    for (int node = 0; node < num_nodes; ++node)
+        new_id_of[order[node]] = node;
+
+    Buffer<unsigned long> new_degrees;
+    new_degrees.resize(num_nodes);
+    unsigned long cumulative = 0;
+    for (int node = 0; node < num_nodes; ++node) {
+        cumulative += num_neighbors(order[node]);
+        new_degrees[node] = cumulative;
     }
 
-    for (int i = 0; i < all_links.size(); ++i) {
-        if (linked[i]) {
-            renum[i] = nb;
-            original_id_to_node_id[i] = nb;
-            ++nb;
+    Buffer<int> new_links;
+    Buffer<float> new_weights;
+    new_links.resize(cumulative);
+    if (weighted)
+        new_weights.resize(cumulative);
+    vector<vector<pair<int, float>>> neighbors_of_thread(nthreads);
+    parallel_for(nthreads, 0, num_nodes, [&](long node, int thread_id) {
+        vector<pair<int, float>>& sorted = neighbors_of_thread[thread_id];
+        int old_node = order[node];
+        unsigned long first = neighbors(old_node).first;
+        int deg = num_neighbors(old_node);
+        sorted.resize(deg);
+        for (int i = 0; i < deg; ++i)
+            sorted[i] = make_pair(new_id_of[links[first + i]], weighted ? weights[first + i] : 1.0f);
+        sort(sorted.begin(), sorted.end());
+
+        unsigned long out = new_degrees[node] - deg;
+        for (int i = 0; i < deg; ++i) {
+            new_links[out + i] = sorted[i].first;
+            if (weighted)
+                new_weights[out + i] = sorted[i].second;
         }
+    }, 1024);
+
+    Buffer<int> new_original_ids;
+    new_original_ids.resize(num_nodes);
+    Buffer<double> new_weighted_degrees;
+    Buffer<double> new_selfloops;
+    new_weighted_degrees.resize(num_nodes);
+    new_selfloops.resize(num_nodes);
+    for (int node = 0; node < num_nodes; ++node) {
+        int old_node = order[node];
+        new_original_ids[node] = node_id_to_original_id[old_node];
+        original_id_to_node_id[new_original_ids[node]] = node;
+        new_weighted_degrees[node] = node_weighted_degrees[old_node];
+        new_selfloops[node] = node_selfloops[old_node];
     }
 
-    for (int i = 0; i < all_links.size(); ++i) {
-        if (!linked[i])
+    degrees = move(new_degrees);
+    links = move(new_links);
+    weights = move(new_weights);
+    node_id_to_original_id = move(new_original_ids);
+    node_weighted_degrees = move(new_weighted_degrees);
+    node_selfloops = move(new_selfloops);
+}
+
+void Graph::reorder(int method, int nthreads)
+{
+    if (method == REORDER_DEGREE)
+        permute(order_by_degree(), nthreads);
+    else if (method == REORDER_RCM)
+        permute(order_by_rcm(), nthreads);
+    else if (method == REORDER_RABBIT)
+        permute(order_by_rabbit(), nthreads);
+}
+
+int Graph::reorder_method(string name)
+{
+    if (name == "degree")
+        return REORDER_DEGREE;
+    if (name == "rcm")
+        return REORDER_RCM;
+    if (name == "rabbit")
+        return REORDER_RABBIT;
+    assert(name == "none");
+    return REORDER_NONE;
+}
+
+vector<int> Graph::order_by_degree()
+{
+    vector<int> order(num_nodes);
+    for (int node = 0; node < num_nodes; ++node)
+        order[node] = node;
+    stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return num_neighbors(a) > num_neighbors(b);
+    });
+    return order;
+}
+
+vector<int> Graph::order_by_rcm()
+{
+    vector<int> by_degree = order_by_degree();
+    reverse(by_degree.begin(), by_degree.end());
+
+    vector<int> order;
+    order.reserve(num_nodes);
+    vector<char> visited(num_nodes, 0);
+    vector<int> next;
+    for (int start : by_degree) {
+        if (visited[start])
             continue;
-        for (int j = 0; j < all_links[i].size(); ++j) {
-            all_links[i][j].first = renum[all_links[i][j].first];
+        visited[start] = 1;
+        order.push_back(start);
+        for (size_t head = order.size() - 1; head < order.size(); ++head) {
+            int node = order[head];
+            unsigned long first = neighbors(node).first;
+            int deg = num_neighbors(node);
+            next.clear();
+            for (int i = 0; i < deg; ++i) {
+                int neigh = links[first + i];
+                if (!visited[neigh]) {
+                    visited[neigh] = 1;
+                    next.push_back(neigh);
+                }
+            }
+            stable_sort(next.begin(), next.end(), [&](int a, int b) {
+                return num_neighbors(a) < num_neighbors(b);
+            });
+            order.insert(order.end(), next.begin(), next.end());
         }
-        all_links[renum[i]] = all_links[i];
     }
+    reverse(order.begin(), order.end());
+    return order;
+}
 
-    all_links.resize(nb);
+vector<int> Graph::order_by_rabbit()
+{
+    // every node starts as its own group; group_of is a union-find over the merges
+    vector<int> group_of(num_nodes);
+    vector<double> group_degree(num_nodes);
+    vector<vector<int>> children(num_nodes);
+    for (int node = 0; node < num_nodes; ++node) {
+        group_of[node] = node;
+        group_degree[node] = node_weighted_degrees[node];
+    }
+    auto find = [&](int node) {
+        while (group_of[node] != node) {
+            group_of[node] = group_of[group_of[node]];
+            node = group_of[node];
+        }
+        return node;
+    };
+
+    vector<double> link_weight(num_nodes, -1);
+    vector<int> touched;
+    vector<int> by_degree = order_by_degree();
+    reverse(by_degree.begin(), by_degree.end());
+    for (int node : by_degree) {
+        int group = find(node);
+        unsigned long first = neighbors(node).first;
+        int deg = num_neighbors(node);
+        for (int i = 0; i < deg; ++i) {
+            int neigh = find(links[first + i]);
+            if (neigh == group)
+                continue;
+            if (link_weight[neigh] < 0) {
+                link_weight[neigh] = 0;
+                touched.push_back(neigh);
+            }
+            link_weight[neigh] += (weights.size() == 0) ? 1 : weights[first + i];
+        }
+
+        // modularity gain of merging the group of node into a neighboring group
+        int best_group = -1;
+        double best_gain = 0;
+        for (int neigh : touched) {
+            double gain = link_weight[neigh] - group_degree[group] * group_degree[neigh] / total_weight;
+            if (gain > best_gain) {
+                best_gain = gain;
+                best_group = neigh;
+            }
+            link_weight[neigh] = -1;
+        }
+        touched.clear();
+
+        if (best_group >= 0) {
+            group_of[group] = best_group;
+            group_degree[best_group] += group_degree[group];
+            children[best_group].push_back(group);
+        }
+    }
+
+    // depth-first layout of every merge tree, children in merge order
+    vector<int> order;
+    order.reserve(num_nodes);
+    vector<int> stack;
+    for (int root = 0; root < num_nodes; ++root) {
+        if (group_of[root] != root)
+            continue;
+        stack.push_back(root);
+        while (!stack.empty()) {
+            int node = stack.back();
+            stack.pop_back();
+            order.push_back(node);
+            for (auto child = children[node].rbegin(); child != children[node].rend(); ++child)
+                stack.push_back(*child);
+        }
+    }
+    return order;
 }
 
 void Graph::display()
 {
     for (int node = 0; node < num_nodes; node++) {
-        pair<int, int> indices = neighbors(node);
-        int link_index = indices.first;
-        int weight_index = indices.second;
+        pair<unsigned long, unsigned long> indices = neighbors(node);
+        unsigned long link_index = indices.first;
+        unsigned long weight_index = indices.second;
         for (int i = 0; i < num_neighbors(node); i++) {
             if (weights.size() == 0)
                 cout << node << " " << links[link_index + i] << " " << weights[weight_index + i] << endl;
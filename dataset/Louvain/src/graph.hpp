@@ -1,4 +1,44 @@
-#include "header.hpp"
+#pragma once
+#include "stats.hpp"
+
+// read-only view of a whole file through mmap
+class MappedFile {
+public:
+    const char* data;
+    size_t size;
+
+    MappedFile(string filepath, int advice = MADV_SEQUENTIAL);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+};
+
+// on-disk CSR graph (.bgr), written by Graph::write_binary and mapped by Graph::read_binary
+//   header
+//   degrees      uint64 x num_nodes    cumulative degree sequence
+//   links        int32  x num_entries  (padded to 8 bytes)
+//   weights      float  x num_entries  (padded to 8 bytes, only with BINARY_GRAPH_WEIGHTS)
+//   original ids int32  x num_nodes    (padded to 8 bytes, only with BINARY_GRAPH_ORIGINAL_IDS)
+// node orderings of Graph::reorder
+#define REORDER_NONE 0
+#define REORDER_DEGREE 1
+#define REORDER_RCM 2
+#define REORDER_RABBIT 3
+
+#define BINARY_GRAPH_MAGIC "LVCSR\0\0"
+#define BINARY_GRAPH_VERSION 1
+#define BINARY_GRAPH_WEIGHTS 1
+#define BINARY_GRAPH_ORIGINAL_IDS 2
+
+struct BinaryGraphHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t num_nodes;
+    uint64_t num_links;
+    uint64_t num_entries;
+    double total_weight;
+};
 
 class Graph {
 public:
@@ -6,25 +46,125 @@ public:
     unsigned long num_links;
     double total_weight;
 
-    vector<unsigned long> degrees;
-    vector<int> links;
-    vector<float> weights;
+    Buffer<unsigned long> degrees;
+    Buffer<int> links;
+    Buffer<float> weights;
 
-    unordered_map<int, int> original_id_to_node_id;
+    // weighted degree and self-loop weight of every node
+    // filled once by compute_node_weights instead of rescanning the neighbors on every call
+    Buffer<double> node_weighted_degrees;
+    Buffer<double> node_selfloops;
+
+    // dense id mappings between this graph and the ids it was built from
+    // (the ids of the edge list, or the community ids of the previous level)
+    // original_id_to_node_id is indexed by original id and holds -1 for ids without a node
+    vector<int> original_id_to_node_id;
+    Buffer<int> node_id_to_original_id;
 
     Graph();
-    Graph(string filepath, int type);
-    vector<vector<pair<int, float>>> read_file(string filepath);
-    void renumber(vector<vector<pair<int, float>>>& all_links);
+
+    // with type == WEIGHTED an edge list is read as "u v w" and its duplicate edges are merged
+    Graph(string filepath, int type, int nthreads = 1);
+
+    // builds degrees/links straight from the mmap'd edge list, parsing it in parallel
+    // pass 1 finds the largest id, pass 2 counts degrees, pass 3 scatters the links
+    // (and the weights of "u v w" lines if weighted, 1 when w is missing)
+    // the order of the neighbors of a node is unspecified when nthreads > 1
+    void read_file(string filepath, int nthreads, bool weighted = false);
+
+    // sorts the neighbors of every node and merges repeated ones into a single entry,
+    // summing their weights, so duplicate and reciprocal edges become one weighted edge
+    void merge_duplicates(int nthreads = 1);
+
+    // true if filepath starts with the magic of the binary format
+    static bool is_binary(string filepath);
+
+    // maps a .bgr file, degrees/links/weights then point into the mapping (no copy)
+    void read_binary(string filepath);
+
+    // reads one of parts shards of a .bgr file: the nodes are split into contiguous ranges of
+    // about as many entries, starts[k] being the first node of shard k (starts[parts] is the
+    // number of nodes); the degrees (cumulative from the first node of the shard), links
+    // (node ids of the whole graph), weights (empty if unweighted) and original ids of the
+    // nodes of shard part are copied out, the rest of the file is never read
+    static BinaryGraphHeader read_binary_shard(string filepath, int parts, int part, vector<int>& starts,
+        vector<unsigned long>& degrees, vector<int>& links, vector<float>& weights, vector<int>& original_ids);
+
+    // writes the graph as a .bgr file
+    void write_binary(string filepath);
+
+    // read-only graph over the arrays of this one (no copy), for runs sharing a loaded graph
+    // original_id_to_node_id is left empty, lookups by original id go through this graph,
+    // which must outlive the view
+    Graph view() const;
+
+    // true if some array views memory owned elsewhere (a mapped file, another graph)
+    bool is_view() const;
+
+    // graph over CSR arrays owned by the caller (no copy), which must outlive it and its views
+    // degrees is cumulative like the one of a .bgr (degrees[node] is the end of the neighbors
+    // of node, the usual n + 1 offsets without the leading 0); links and weights (NULL when
+    // unweighted) hold degrees[num_nodes - 1] entries, every edge in both directions and
+    // self-loops once; original_ids are the ids written out for the nodes (NULL: 0..n-1)
+    static Graph from_csr(int num_nodes, const unsigned long* degrees, const int* links, const float* weights,
+        const int* original_ids = NULL, int nthreads = 1);
+
+    // builds the .bgr file of an edge list that may not fit in memory
+    // edges are sorted in runs of memory_bytes, spilled next to output_path and merged
+    // straight into the links of the output; only the per-node arrays are kept in memory
+    // in a weighted edge list ("u v w"), duplicate and reciprocal edges are summed into one
+    // edge as the runs are merged, which gives the same file as a weighted load writes
+    // neighbors end up sorted by node id, map the result with read_binary
+    static void build_binary(string input_path, string output_path, size_t memory_bytes, int nthreads = 1,
+        bool weighted = false);
+
+    // turns the per-id degree counts into the cumulative degree sequence of the
+    // linked ids (renumbered from 0 in increasing order) and fills the id mappings
+    void renumber(vector<unsigned long>& counts);
+
+    // applies a batch of edge updates read from filepath, one per line:
+    //   + u v [w]     insert the edge u v (weight w, default 1)
+    //   - u v         delete one occurrence of the edge u v
+    // ids are original ids; unknown ids become new nodes numbered after the existing ones,
+    // so existing node ids do not change; deleting a missing edge is ignored
+    // touched receives the nodes whose neighbors changed
+    void apply_updates(string filepath, vector<int>& touched, int nthreads = 1);
+
+    // fills node_weighted_degrees and node_selfloops from degrees/links/weights
+    void compute_node_weights(int nthreads = 1);
+
+    // renumbers the nodes for locality, order[new id] = old id; links, weights, node
+    // weights and both id mappings follow, so the ids seen outside do not change
+    // the neighbors of every node end up sorted by their new id
+    void permute(const vector<int>& order, int nthreads = 1);
+
+    // reorders the nodes with one of the REORDER_ methods (see order_by_*)
+    void reorder(int method, int nthreads = 1);
+
+    // REORDER_ method named degree, rcm, rabbit or none
+    static int reorder_method(string name);
+
+    // decreasing degree, so that the hubs and their state share a few cache lines
+    vector<int> order_by_degree();
+
+    // reverse Cuthill-McKee: a BFS from a low-degree node of every component, visiting
+    // neighbors by increasing degree, reversed; neighbors get close ids
+    vector<int> order_by_rcm();
+
+    // Rabbit order (simplified): nodes in increasing degree are merged into the
+    // neighboring group with the best modularity gain, then every merge tree is laid
+    // out depth first, so that each dense group gets a contiguous range of ids
+    vector<int> order_by_rabbit();
 
     void display();
 
     inline int num_neighbors(int node);
-    inline int num_selfloops(int node);
+    inline double num_selfloops(int node);
     inline double weighted_degree(int node);
 
-    // return pointers to the first neighbor and first weight of the node
-    inline pair<int, int> neighbors(int node);
+    // return the indices of the first neighbor and first weight of the node
+    // (64-bit, an out-of-core graph may have more than 2^31 entries)
+    inline pair<unsigned long, unsigned long> neighbors(int node);
 
     void print_links()
     {
@@ -55,41 +195,19 @@ inline int Graph::num_neighbors(int node)
         return degrees[node] - degrees[node - 1]; // cumulative sum?
 }
 
-// This method doesn't seem efficient
-inline int Graph::num_selfloops(int node)
+inline double Graph::num_selfloops(int node)
 {
     assert(node >= 0 && node < num_nodes);
-    pair<int, int> indices = neighbors(node);
-    int link_index = indices.first;
-    int weight_index = indices.second;
-
-    for (int i = 0; i < num_neighbors(node); ++i) {
-        if (links[link_index + i] != node)
-            continue;
-        if (weights.size() == 0)
-            return 1;
-        return weights[weight_index + i];
-    }
-
-    return 0;
+    return node_selfloops[node];
 }
 
 inline double Graph::weighted_degree(int node)
 {
     assert(node >= 0 && node < num_nodes);
-
-    pair<int, int> indices = neighbors(node);
-    int link_index = indices.first;
-    int weight_index = indices.second;
-    if (weights.size() == 0)
-        return num_neighbors(node);
-    int res = 0;
-    for (int i = 0; i < num_neighbors(node); i++)
-        res += weights[weight_index + i];
-    return res;
+    return node_weighted_degrees[node];
 }
 
-inline pair<int, int> Graph::neighbors(int node)
+inline pair<unsigned long, unsigned long> Graph::neighbors(int node)
 {
     assert(node >= 0 && node < num_nodes);
 
@@ -99,8 +217,8 @@ inline pair<int, int> Graph::neighbors(int node)
     //     return make_pair(links.begin() + degrees[node - 1], weights.begin());
     // return make_pair(links.begin() + degrees[node - 1], weights.begin() + degrees[node - 1]);
     if (node == 0)
-        return make_pair(0, 0);
+        return make_pair(0UL, 0UL);
     if (weights.size() == 0)
-        return make_pair(degrees[node - 1], 0);
+        return make_pair(degrees[node - 1], 0UL);
     return make_pair(degrees[node - 1], degrees[node - 1]);
 }
\ No newline at end of file
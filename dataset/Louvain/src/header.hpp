@@ -1,16 +1,26 @@
+#pragma once
 #include <algorithm>
 #include <assert.h>
+#include <atomic>
 #include <chrono>
 #include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <deque>
+#include <fcntl.h>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <queue>
 #include <random>
 #include <sstream>
 #include <string>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -23,11 +33,120 @@
 #define UNWEIGHTED 1
 using namespace std;
 
-void print_vector(vector<int> nums)
+// array that either owns its elements or views memory owned by someone else
+// (an mmap'd file, a caller's array); keep holds whatever keeps that memory alive
+// a view is read-only, resize() always switches to owned storage
+template <typename T>
+class Buffer {
+public:
+    Buffer()
+        : ptr(NULL)
+        , n(0)
+        , borrowed(false)
+    {
+    }
+
+    Buffer(const Buffer& other) { *this = other; }
+    Buffer(Buffer&& other) noexcept { *this = move(other); }
+
+    Buffer& operator=(const Buffer& other)
+    {
+        owned = other.owned;
+        keep = other.keep;
+        n = other.n;
+        borrowed = other.borrowed;
+        ptr = borrowed ? other.ptr : owned.data();
+        return *this;
+    }
+
+    Buffer& operator=(Buffer&& other) noexcept
+    {
+        borrowed = other.borrowed;
+        ptr = other.ptr;
+        n = other.n;
+        owned = move(other.owned);
+        keep = move(other.keep);
+        other.ptr = NULL;
+        other.n = 0;
+        other.borrowed = false;
+        return *this;
+    }
+
+    // view n elements at p, keep is released with the last copy of this buffer
+    void view(const T* p, size_t size, shared_ptr<const void> keeper)
+    {
+        owned.clear();
+        owned.shrink_to_fit();
+        keep = keeper;
+        ptr = (T*)p;
+        n = size;
+        borrowed = true;
+    }
+
+    void resize(size_t size, T value = T())
+    {
+        if (borrowed) {
+            owned.assign(ptr, ptr + min(n, size));
+            keep.reset();
+            borrowed = false;
+        }
+        owned.resize(size, value);
+        ptr = owned.data();
+        n = size;
+    }
+
+    bool is_view() const { return borrowed; }
+    size_t size() const { return n; }
+    T* data() { return ptr; }
+    const T* data() const { return ptr; }
+    T* begin() { return ptr; }
+    T* end() { return ptr + n; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + n; }
+    inline T& operator[](size_t i) { return ptr[i]; }
+    inline const T& operator[](size_t i) const { return ptr[i]; }
+
+private:
+    vector<T> owned;
+    shared_ptr<const void> keep;
+    T* ptr;
+    size_t n;
+    bool borrowed;
+};
+
+inline void print_vector(vector<int> nums)
 {
     cout << "[" << nums[0];
     for (int i = 1; i < nums.size(); ++i) {
         cout << ", " << nums[i];
     }
     cout << "]" << endl;
+}
+
+// run f(i, thread) for every i in [begin, end) on num_threads threads
+// iterations are handed out in chunks so that a block of hubs does not stall one thread
+template <typename F>
+void parallel_for(int num_threads, long begin, long end, F f, long chunk = 256)
+{
+    if (num_threads <= 1 || end - begin <= chunk) {
+        for (long i = begin; i < end; ++i)
+            f(i, 0);
+        return;
+    }
+
+    atomic<long> next(begin);
+    auto worker = [&](int thread_id) {
+        for (long first = next.fetch_add(chunk); first < end; first = next.fetch_add(chunk)) {
+            long last = min(first + chunk, end);
+            for (long i = first; i < last; ++i)
+                f(i, thread_id);
+        }
+    };
+
+    vector<thread> threads;
+    for (int t = 1; t < num_threads; ++t)
+        threads.emplace_back(worker, t);
+    worker(0);
+    for (auto& t : threads)
+        t.join();
 }
\ No newline at end of file
@@ -0,0 +1,38 @@
+#include "dendrogram.hpp"
+
+// reads a dendrogram written by louvain -d
+// usage: ./hierarchy <file.dendro>          number of communities at every level
+//        ./hierarchy <file.dendro> <level>  "original community" for every input node at that level
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <file.dendro> [level]" << endl;
+        return 1;
+    }
+
+    Dendrogram d;
+    d.read_binary(argv[1]);
+
+    if (argc < 3) {
+        cout << "levels: " << d.num_levels() << endl;
+        int num_nodes = d.node_id_to_original_id.size();
+        for (int level = 0; level < d.num_levels(); ++level) {
+            int num_communities = 0;
+            for (int c : d.levels[level])
+                num_communities = max(num_communities, c + 1);
+            cout << "level " << level << ": " << num_nodes << " nodes -> " << num_communities << " communities" << endl;
+            num_nodes = num_communities;
+        }
+        return 0;
+    }
+
+    int level = atoi(argv[2]);
+    if (level < 0 || level >= d.num_levels()) {
+        cerr << "level must be in [0, " << d.num_levels() << ")" << endl;
+        return 1;
+    }
+    vector<int> partition = d.partition_at(level);
+    for (int node = 0; node < partition.size(); ++node)
+        cout << d.node_id_to_original_id[node] << " " << partition[node] << "\n";
+    return 0;
+}
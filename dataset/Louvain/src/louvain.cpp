@@ -1,101 +1,220 @@
-#include "community.cpp"
+#include "distributed.hpp"
 
-#define PRECISION 0.000001
-#define DISPLAY_LEVEL -2
-
-void display_time(const char* str)
+// writes "original community" for every node
+static void write_partition(string filepath, const int* original_ids, const vector<int>& partition)
 {
-    time_t rawtime;
-    time(&rawtime);
-    cerr << str << " : " << ctime(&rawtime);
-}
-
-void update_original_node_community(unordered_map<int, int>& original_id_to_community, vector<int>& community_of, unordered_map<int, int>& renum)
-{
-    for (auto [node, c] : original_id_to_community) {
-        int community = community_of[c];
-        int new_community = renum[community];
-        original_id_to_community[node] = new_community;
-    }
+    ofstream output(filepath);
+    for (size_t node = 0; node < partition.size(); ++node)
+        output << original_ids[node] << " " << partition[node] << "\n";
 }
 
 int main(int argc, char** argv)
 {
-    srand(time(NULL));
-
     time_t time_begin, time_end;
     time(&time_begin);
+    chrono::steady_clock::time_point clock_begin = chrono::steady_clock::now();
     display_time("start");
 
     string filepath = argv[1];
 
-    Community c(filepath, UNWEIGHTED, PRECISION);
-
-    display_time("file read");
-    // c.g.print_links();
-    // c.g.print_degrees();
-
-    double mod = c.modularity();
-
-    cerr << "network : "
-         << c.g.num_nodes << " nodes, "
-         << c.g.num_links << " links, "
-         << c.g.total_weight << " weight." << endl;
-
-    double new_mod = c.one_level();
-    unordered_map<int, int> original_id_to_community;
-    for (auto [node, c] : c.g.original_id_to_node_id) {
-        original_id_to_community[node] = c;
+    // options
+    //   -t <threads> : threads for the local-moving phase (0 = all cores)
+    //   -d <file>    : write the whole dendrogram (read it back with ./hierarchy)
+    //   -l <level>   : write the communities of that level to the .cm file (default: last)
+    //   -p           : pruning, only revisit the neighbors of nodes that moved
+    //   -r           : Leiden refinement between local moving and aggregation
+    //   -i <file.cm> : start from a previous partition instead of singletons
+    //   -u <file>    : apply a batch of edge updates first (see Graph::apply_updates); with -i
+    //                  only the nodes touched by the batch are revisited on the first level
+    //   -w <file>    : write the updated graph as a .bgr file (for the next batch)
+    //   -m <MB>      : edge list larger than memory, build its .bgr next to it out of core
+    //                  with that much memory for edges and run on the mapped file
+    //   -W           : weighted edge list ("u v w"), duplicate edges are merged at load time
+    //   -s <seed>    : seed of the random generator (default: time)
+    //   -b <file>    : append the time of every phase, the modularity and the peak RSS to
+    //                  a .csv file (or .json, one run per line)
+    //   -o <file>    : write the communities there instead of community/<graph>.cm
+    //   -e <runs>    : ensemble, that many runs with random node orders (seeds seed .. seed + runs - 1)
+    //                  on -t threads sharing the loaded graph; the best partition is written
+    //   -k <file>    : with -e, also write the consensus partition of the runs to file
+    //   -R <order>   : renumber the nodes for locality after loading: degree, rcm or rabbit
+    //   -a <delta>   : convergence threshold of level 0, divided by 10 on every level down to
+    //                  the default 0.000001; the levels then run again tight from the
+    //                  communities found, projected onto the input graph
+    //   -n <passes>  : at most that many passes per level (before the tight run)
+    //   -D <workers> : distributed mode, that many worker processes (connected by Unix sockets)
+    //                  each owning a shard of the .bgr file (built next to the graph if needed);
+    //                  -p, -r, -i, -u, -e, -R, -a, -n, -l and -d do not apply
+    //   -c           : read cycles, instructions, cache and branch misses around every phase
+    //                  (Linux perf_event_open) and print them per level at the end
+    int num_threads = 1;
+    string dendrogram_path = "";
+    int output_level = -1;
+    bool pruning = false;
+    bool refine = false;
+    string partition_path = "";
+    string updates_path = "";
+    string updated_graph_path = "";
+    size_t memory_megabytes = 0;
+    int type = UNWEIGHTED;
+    long seed = time(NULL);
+    string stats_path = "";
+    string output_path = "";
+    int reorder = REORDER_NONE;
+    int ensemble_runs = 0;
+    string consensus_path = "";
+    ThresholdSchedule schedule;
+    int num_workers = 0;
+    Stats stats;
+    run_stats = &stats;
+    for (int i = 2; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "-t" && i + 1 < argc)
+            num_threads = atoi(argv[++i]);
+        else if (option == "-d" && i + 1 < argc)
+            dendrogram_path = argv[++i];
+        else if (option == "-l" && i + 1 < argc)
+            output_level = atoi(argv[++i]);
+        else if (option == "-p")
+            pruning = true;
+        else if (option == "-r")
+            refine = true;
+        else if (option == "-i" && i + 1 < argc)
+            partition_path = argv[++i];
+        else if (option == "-u" && i + 1 < argc)
+            updates_path = argv[++i];
+        else if (option == "-w" && i + 1 < argc)
+            updated_graph_path = argv[++i];
+        else if (option == "-m" && i + 1 < argc)
+            memory_megabytes = atol(argv[++i]);
+        else if (option == "-W")
+            type = WEIGHTED;
+        else if (option == "-s" && i + 1 < argc)
+            seed = atol(argv[++i]);
+        else if (option == "-b" && i + 1 < argc)
+            stats_path = argv[++i];
+        else if (option == "-o" && i + 1 < argc)
+            output_path = argv[++i];
+        else if (option == "-c")
+            stats.counters = true;
+        else if (option == "-R" && i + 1 < argc)
+            reorder = Graph::reorder_method(argv[++i]);
+        else if (option == "-e" && i + 1 < argc)
+            ensemble_runs = atoi(argv[++i]);
+        else if (option == "-k" && i + 1 < argc)
+            consensus_path = argv[++i];
+        else if (option == "-a" && i + 1 < argc)
+            schedule.initial = atof(argv[++i]);
+        else if (option == "-n" && i + 1 < argc)
+            schedule.max_passes = atoi(argv[++i]);
+        else if (option == "-D" && i + 1 < argc)
+            num_workers = atoi(argv[++i]);
+    }
+    if (num_threads <= 0)
+        num_threads = max(1u, thread::hardware_concurrency());
+    srand(seed);
+
+    PhaseTimer load_timer("load");
+    string graph_path = filepath;
+    if (memory_megabytes > 0 && !Graph::is_binary(filepath)) {
+        graph_path = filepath.substr(0, filepath.rfind('.')) + ".bgr";
+        Graph::build_binary(filepath, graph_path, memory_megabytes << 20, num_threads, type == WEIGHTED);
+        display_time("binary graph built");
     }
 
-    display_time("communities computed");
-    cerr << "modularity increased from " << mod << " to " << new_mod << endl;
-
-    if (DISPLAY_LEVEL == -1)
-        c.display_partition();
-
-    Graph g = c.partition2graph_binary();
-    update_original_node_community(original_id_to_community, c.community_of, g.original_id_to_node_id);
-
-    display_time("network of communities computed");
-
-    int level = 0;
-    while (new_mod - mod > PRECISION) {
-        mod = new_mod;
-        Community c(g, PRECISION);
-
-        cerr << "\nnetwork : "
-             << c.g.num_nodes << " nodes, "
-             << c.g.num_links << " links, "
-             << c.g.total_weight << " weight." << endl;
-
-        new_mod = c.one_level();
-
-        display_time("communities computed");
-        cerr << "modularity increased from " << mod << " to " << new_mod << endl;
-
-        if (DISPLAY_LEVEL == -1)
-            c.display_partition();
-
-        g = c.partition2graph_binary();
-        level++;
-
-        update_original_node_community(original_id_to_community, c.community_of, g.original_id_to_node_id);
-
-        if (level == DISPLAY_LEVEL)
-            g.display();
-
-        display_time("network of communities computed");
+    vector<int> ids;
+    vector<int> node_community;
+    LouvainResult result;
+    unique_ptr<SocketTransport> transport;
+    if (num_workers > 0) {
+        // distributed mode: the workers read their shard of the .bgr file and cluster it together
+        if (!Graph::is_binary(graph_path)) {
+            graph_path = filepath.substr(0, filepath.rfind('.')) + ".bgr";
+            Graph(filepath, type, num_threads).write_binary(graph_path);
+            display_time("binary graph built");
+        }
+        load_timer.stop();
+        transport = SocketTransport::fork_workers(num_workers);
+        result.modularity = distributed_louvain(*transport, graph_path, ids, node_community, true);
+        if (transport->rank() != 0)
+            return 0;
+    } else {
+        Graph g(graph_path, type, num_threads);
+        load_timer.stop();
+
+        display_time("file read");
+
+        if (reorder != REORDER_NONE) {
+            PhaseTimer timer("reorder");
+            g.reorder(reorder, num_threads);
+            display_time("nodes reordered");
+        }
+
+        LouvainOptions options;
+        options.num_threads = num_threads;
+        options.pruning = pruning;
+        options.refine = refine;
+        options.ensemble_runs = ensemble_runs;
+        options.seed = seed;
+        options.verbose = true;
+        options.schedule = schedule;
+        options.stats = &stats;
+
+        // dynamic mode: update the graph, then revisit only what the batch touched
+        if (updates_path != "") {
+            PhaseTimer timer("updates");
+            g.apply_updates(updates_path, options.active_nodes, num_threads);
+            if (updated_graph_path != "")
+                g.write_binary(updated_graph_path);
+            display_time("updates applied");
+        }
+        if (partition_path != "")
+            options.initial_partition = read_partition(partition_path, g);
+        // g.print_links();
+        // g.print_degrees();
+
+        result = louvain(g, options);
+        if (ensemble_runs > 0) {
+            for (int run = 0; run < ensemble_runs; ++run)
+                cerr << "run " << run << " (seed " << seed + run << ") : modularity " << result.run_modularities[run] << endl;
+            cerr << "best run : " << result.best_run << endl;
+
+            if (consensus_path != "") {
+                vector<int> consensus = consensus_partition(g, result.run_partitions, num_threads);
+                write_partition(consensus_path, g.node_id_to_original_id.data(), consensus);
+            }
+            display_time("ensemble computed");
+        }
+
+        ids.assign(g.node_id_to_original_id.begin(), g.node_id_to_original_id.end());
+        if (output_level < 0 || output_level >= result.dendrogram.num_levels())
+            output_level = result.dendrogram.num_levels() - 1;
+        node_community = result.dendrogram.partition_at(output_level);
     }
+    double new_mod = result.modularity;
     time(&time_end);
 
-    string output_path = "community/" + filepath.substr(6);
-    output_path.replace(output_path.end() - 2, output_path.end(), "cm");
+    stats.level = -1;
+    PhaseTimer output_timer("output");
+    if (output_path == "") {
+        output_path = "community/" + filepath.substr(6);
+        output_path.replace(output_path.begin() + output_path.rfind('.') + 1, output_path.end(), "cm");
+    }
     cout << output_path << endl;
-    ofstream output(output_path);
-
-    for (auto [original, community] : original_id_to_community) {
-        output << original << " " << community << endl;
+    write_partition(output_path, ids.data(), node_community);
+    if (dendrogram_path != "" && num_workers == 0)
+        result.dendrogram.write_binary(dendrogram_path);
+    output_timer.stop();
+
+    if (stats.counters)
+        stats.print_counters(cerr);
+    if (stats_path != "") {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - clock_begin).count();
+        string graph = filepath.substr(filepath.rfind('/') + 1);
+        if (stats_path.size() >= 5 && stats_path.substr(stats_path.size() - 5) == ".json")
+            stats.write_json(stats_path, graph, num_threads, seed, seconds, new_mod);
+        else
+            stats.write_csv(stats_path, graph, num_threads, seed, seconds, new_mod);
     }
 
     cerr << PRECISION << " " << new_mod << " " << (time_end - time_begin) << endl;
@@ -0,0 +1,277 @@
+#include "pipeline.hpp"
+
+void display_time(const char* str)
+{
+    time_t rawtime;
+    time(&rawtime);
+    cerr << str << " : " << ctime(&rawtime);
+}
+
+void next_level(Community& c, bool refine, Dendrogram& dendrogram, vector<int>& next_partition, Graph& next)
+{
+    if (!refine) {
+        c.partition2graph_binary(c.community_of, next);
+        dendrogram.add_level(c.community_of, next.original_id_to_node_id);
+        return;
+    }
+
+    c.refine();
+    c.partition2graph_binary(c.refined_of, next);
+    dendrogram.add_level(c.refined_of, next.original_id_to_node_id);
+    next_partition = c.aggregate_partition(next.original_id_to_node_id, next.num_nodes);
+}
+
+bool communities_left_to_merge(const Graph& g, int previous_num_nodes, const vector<int>& next_partition)
+{
+    int num_communities = 0;
+    for (int comm : next_partition)
+        num_communities = max(num_communities, comm + 1);
+    return num_communities < g.num_nodes && g.num_nodes < previous_num_nodes;
+}
+
+vector<int> read_partition(string filepath, const Graph& g)
+{
+    ifstream finput(filepath);
+    assert(finput.good());
+
+    vector<int> partition(g.num_nodes, -1);
+    vector<int> dense;
+    int nb = 0;
+    int original, comm;
+    while (finput >> original >> comm) {
+        if (original < 0 || original >= g.original_id_to_node_id.size() || g.original_id_to_node_id[original] < 0)
+            continue;
+        if (comm >= (int)dense.size())
+            dense.resize(comm + 1, -1);
+        if (dense[comm] < 0)
+            dense[comm] = nb++;
+        partition[g.original_id_to_node_id[original]] = dense[comm];
+    }
+    for (int node = 0; node < g.num_nodes; ++node)
+        if (partition[node] < 0)
+            partition[node] = nb++;
+    return partition;
+}
+
+double run_levels(Community& c, bool pruning, bool refine, Dendrogram& dendrogram,
+    const ThresholdSchedule& schedule)
+{
+    double mod = c.modularity();
+
+    if (c.verbose)
+        cerr << "network : "
+             << c.g.num_nodes << " nodes, "
+             << c.g.num_links << " links, "
+             << c.g.total_weight << " weight." << endl;
+
+    set_stats_level(0);
+    PhaseTimer level_timer("level");
+    c.min_modularity = schedule.threshold(0);
+    c.max_passes = schedule.max_passes;
+    double new_mod = c.one_level();
+    level_timer.stop();
+    c.pruning = pruning;
+
+    if (c.verbose) {
+        display_time("communities computed");
+        cerr << "modularity increased from " << mod << " to " << new_mod << endl;
+    }
+
+    if (DISPLAY_LEVEL == -1)
+        c.display_partition();
+
+    // the graph of the next level is built into next and swapped with c.g, so the two
+    // graphs serve as ping-pong arenas and c keeps its state arrays from level to level
+    // the input graph is a view and cannot be built into, so the first two contractions
+    // allocate the CSR arrays of the two arenas and the later ones reuse them
+    Graph next;
+    vector<int> next_partition;
+    PhaseTimer contraction_timer("contraction");
+    next_level(c, refine, dendrogram, next_partition, next);
+    contraction_timer.stop();
+
+    if (c.verbose)
+        display_time("network of communities computed");
+
+    int level = 0;
+    int previous_num_nodes = c.g.num_nodes;
+    while (true) {
+        if (new_mod - mod <= PRECISION && !(refine && communities_left_to_merge(next, previous_num_nodes, next_partition)))
+            break;
+        mod = new_mod;
+        previous_num_nodes = next.num_nodes;
+        set_stats_level(level + 1);
+        PhaseTimer level_timer("level");
+        c.next_graph(next);
+        if (refine)
+            c.init_partition(next_partition);
+        c.min_modularity = schedule.threshold(level + 1);
+        c.max_passes = schedule.max_passes;
+
+        if (c.verbose)
+            cerr << "\nnetwork : "
+                 << c.g.num_nodes << " nodes, "
+                 << c.g.num_links << " links, "
+                 << c.g.total_weight << " weight." << endl;
+
+        new_mod = c.one_level();
+        level_timer.stop();
+
+        if (c.verbose) {
+            display_time("communities computed");
+            cerr << "modularity increased from " << mod << " to " << new_mod << endl;
+        }
+
+        if (DISPLAY_LEVEL == -1)
+            c.display_partition();
+
+        PhaseTimer contraction_timer("contraction");
+        next_level(c, refine, dendrogram, next_partition, next);
+        contraction_timer.stop();
+        level++;
+
+        if (level == DISPLAY_LEVEL)
+            next.display();
+
+        if (c.verbose)
+            display_time("network of communities computed");
+    }
+    // the refined graph of the last level still has to be folded into its communities
+    if (refine)
+        dendrogram.add_level(next_partition);
+    return new_mod;
+}
+
+double run_schedule(const Graph& g, Community& c, bool pruning, bool refine, Dendrogram& dendrogram,
+    const ThresholdSchedule& schedule)
+{
+    double mod = run_levels(c, pruning, refine, dendrogram, schedule);
+    if (!schedule.loose(0))
+        return mod;
+
+    if (c.verbose)
+        cerr << "\ntightening on the finest graph from the " << mod << " partition" << endl;
+    // c goes back to the input graph (the coarsest graph left in finest is dropped) and
+    // starts from the communities found, projected onto the nodes of g
+    Graph finest = g.view();
+    c.next_graph(finest);
+    c.init_partition(dendrogram.partition_at(dendrogram.num_levels() - 1));
+    c.pruning = pruning;
+    dendrogram = Dendrogram(c.g);
+    return run_levels(c, pruning, refine, dendrogram);
+}
+
+vector<Dendrogram> run_ensemble(const Graph& g, int num_runs, long seed, bool pruning, bool refine, int num_threads,
+    vector<double>& modularities, const ThresholdSchedule& schedule)
+{
+    vector<Dendrogram> dendrograms(num_runs);
+    modularities.assign(num_runs, 0);
+    parallel_for(min(num_threads, num_runs), 0, num_runs, [&](long run, int) {
+        Community c(g.view(), PRECISION, 1, 1);
+        c.pruning = pruning;
+        c.move_to_empty = refine;
+        c.shuffle = true;
+        c.generator.seed(seed + run);
+        c.verbose = false;
+        dendrograms[run] = Dendrogram(c.g);
+        modularities[run] = run_schedule(g, c, pruning, refine, dendrograms[run], schedule);
+    }, 1);
+    return dendrograms;
+}
+
+vector<int> consensus_partition(Graph& g, const vector<vector<int>>& partitions, int num_threads)
+{
+    int num_runs = partitions.size();
+    auto agreement = [&](int node, int neigh) {
+        int agreements = 0;
+        for (const vector<int>& partition : partitions)
+            agreements += partition[node] == partition[neigh];
+        return (float)agreements / num_runs;
+    };
+
+    Graph consensus_graph;
+    consensus_graph.num_nodes = g.num_nodes;
+    vector<unsigned long> kept(g.num_nodes);
+    parallel_for(num_threads, 0, g.num_nodes, [&](long node, int) {
+        unsigned long first = g.neighbors(node).first;
+        int deg = g.num_neighbors(node);
+        kept[node] = 0;
+        for (int i = 0; i < deg; ++i)
+            kept[node] += agreement(node, g.links[first + i]) > 0.5;
+    });
+    consensus_graph.degrees.resize(g.num_nodes);
+    unsigned long cumulative = 0;
+    for (int node = 0; node < g.num_nodes; ++node) {
+        cumulative += kept[node];
+        consensus_graph.degrees[node] = cumulative;
+    }
+    consensus_graph.links.resize(cumulative);
+    consensus_graph.weights.resize(cumulative);
+    vector<unsigned long> selfloops_of_thread(num_threads, 0);
+    parallel_for(num_threads, 0, g.num_nodes, [&](long node, int thread_id) {
+        unsigned long first = g.neighbors(node).first;
+        int deg = g.num_neighbors(node);
+        unsigned long out = consensus_graph.degrees[node] - kept[node];
+        for (int i = 0; i < deg; ++i) {
+            int neigh = g.links[first + i];
+            float w = agreement(node, neigh);
+            if (w <= 0.5)
+                continue;
+            consensus_graph.links[out] = neigh;
+            consensus_graph.weights[out++] = w * ((g.weights.size() == 0) ? 1 : g.weights[first + i]);
+            selfloops_of_thread[thread_id] += neigh == node;
+        }
+    });
+    unsigned long num_selfloops = 0;
+    for (unsigned long selfloops : selfloops_of_thread)
+        num_selfloops += selfloops;
+    consensus_graph.num_links = (cumulative + num_selfloops) / 2;
+    consensus_graph.node_id_to_original_id.resize(g.num_nodes);
+    consensus_graph.original_id_to_node_id.resize(g.num_nodes);
+    for (int node = 0; node < g.num_nodes; ++node)
+        consensus_graph.node_id_to_original_id[node] = consensus_graph.original_id_to_node_id[node] = node;
+    consensus_graph.compute_node_weights(num_threads);
+    consensus_graph.total_weight = 0;
+    for (int node = 0; node < g.num_nodes; ++node)
+        consensus_graph.total_weight += consensus_graph.node_weighted_degrees[node];
+
+    Community c(move(consensus_graph), PRECISION, 1, 1);
+    c.verbose = false;
+    Dendrogram dendrogram(c.g);
+    run_levels(c, false, false, dendrogram);
+    return dendrogram.partition_at(dendrogram.num_levels() - 1);
+}
+
+LouvainResult louvain(const Graph& g, const LouvainOptions& options)
+{
+    Stats* caller_stats = run_stats;
+    run_stats = options.stats;
+    LouvainResult result;
+    result.best_run = 0;
+    if (options.ensemble_runs > 0) {
+        vector<Dendrogram> dendrograms = run_ensemble(g, options.ensemble_runs, options.seed, options.pruning,
+            options.refine, options.num_threads, result.run_modularities, options.schedule);
+        result.best_run = max_element(result.run_modularities.begin(), result.run_modularities.end()) - result.run_modularities.begin();
+        result.modularity = result.run_modularities[result.best_run];
+        for (const Dendrogram& d : dendrograms)
+            result.run_partitions.push_back(d.partition_at(d.num_levels() - 1));
+        result.dendrogram = move(dendrograms[result.best_run]);
+    } else {
+        Community c(g.view(), PRECISION, 1, options.num_threads);
+        c.pruning = options.pruning;
+        c.move_to_empty = options.refine;
+        c.verbose = options.verbose;
+        if (!options.initial_partition.empty())
+            c.init_partition(options.initial_partition);
+        if (!options.initial_partition.empty() && !options.active_nodes.empty()) {
+            c.pruning = true;
+            c.activate(options.active_nodes);
+        }
+        result.dendrogram = Dendrogram(c.g);
+        result.modularity = run_schedule(g, c, options.pruning, options.refine, result.dendrogram, options.schedule);
+        result.run_modularities.push_back(result.modularity);
+    }
+    result.partition = result.dendrogram.partition_at(result.dendrogram.num_levels() - 1);
+    run_stats = caller_stats;
+    return result;
+}
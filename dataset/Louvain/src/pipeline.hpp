@@ -0,0 +1,108 @@
+#pragma once
+#include "community.hpp"
+#include "dendrogram.hpp"
+
+// the Louvain pipeline as a library: link graph.cpp, community.cpp, dendrogram.cpp and
+// pipeline.cpp (or liblouvain.a, see run.sh) and call louvain() on a Graph, loaded from a
+// file or built over the caller's CSR arrays with Graph::from_csr
+
+#define PRECISION 0.000001
+#define DISPLAY_LEVEL -2
+
+// convergence threshold of every level: the large early levels stop on a loose threshold,
+// divided by decay_factor from one level to the next down to PRECISION, and every level is
+// capped at max_passes (0: no limit); the default is PRECISION everywhere, uncapped
+struct ThresholdSchedule {
+    double initial = PRECISION;
+    double decay_factor = 10;
+    int max_passes = 0;
+
+    double threshold(int level) const { return max((double)PRECISION, initial / pow(decay_factor, level)); }
+
+    // true if the level may have stopped before the tight threshold would have
+    bool loose(int level) const { return threshold(level) > PRECISION || max_passes > 0; }
+};
+
+// options of a run, the library side of the options of the louvain command
+struct LouvainOptions {
+    // threads of the local-moving phase, or concurrent runs with ensemble_runs
+    int num_threads = 1;
+    // only revisit the neighbors of nodes that moved (-p)
+    bool pruning = false;
+    // Leiden refinement between local moving and aggregation (-r)
+    bool refine = false;
+    // community of every node to start from (-i), singletons if empty
+    vector<int> initial_partition;
+    // with initial_partition, only these nodes are revisited on the first level (-u), all if empty
+    vector<int> active_nodes;
+    // that many runs with random node orders, the best one is returned (-e)
+    int ensemble_runs = 0;
+    // run k of an ensemble draws its node order from seed + k (-s)
+    long seed = 0;
+    // print the progress of every level and pass on cerr
+    bool verbose = false;
+    // threshold of every level (-a) and passes per level (-n)
+    ThresholdSchedule schedule;
+    // the phases of the run are appended there (-b, -c), owned by the caller; NULL records nothing
+    Stats* stats = NULL;
+};
+
+struct LouvainResult {
+    // community of every node of the graph at the last level
+    vector<int> partition;
+    // every level, with the original ids of the nodes
+    Dendrogram dendrogram;
+    double modularity;
+    // with ensemble_runs: modularity and partition of every run, and the run returned
+    vector<double> run_modularities;
+    vector<vector<int>> run_partitions;
+    int best_run;
+};
+
+// runs Louvain on g, which is only read (the runs work on views of it) and must outlive the call
+LouvainResult louvain(const Graph& g, const LouvainOptions& options = LouvainOptions());
+
+void display_time(const char* str);
+
+// contracts the communities of c into next, the graph of the next level, and records the level
+// with refinement the graph is built from the refined subcommunities, and next_partition
+// receives the community each of its nodes starts in
+void next_level(Community& c, bool refine, Dendrogram& dendrogram, vector<int>& next_partition, Graph& next);
+
+// with refinement the levels go on while some community is still made of several
+// subcommunities and the graph keeps shrinking; once every community is a single node
+// of the refined graph, each community is one refined subcommunity and thus connected
+bool communities_left_to_merge(const Graph& g, int previous_num_nodes, const vector<int>& next_partition);
+
+// reads a .cm file ("original community" per line) as a partition of the nodes of g
+// communities are renumbered from 0, nodes missing from the file get their own community
+vector<int> read_partition(string filepath, const Graph& g);
+
+// runs the levels of the Louvain pipeline from c, set up for the first level, until
+// modularity stops increasing; every level is recorded in dendrogram (built from c.g)
+// level k stops its passes on schedule.threshold(k) and after schedule.max_passes
+// c itself moves on to the next levels (see Community::next_graph), its graph and arrays
+// are reused instead of building a new Community per level, so c.g is no longer the
+// graph c was built on once this returns
+// returns the modularity of the last level
+double run_levels(Community& c, bool pruning, bool refine, Dendrogram& dendrogram,
+    const ThresholdSchedule& schedule = ThresholdSchedule());
+
+// run_levels with schedule on c, built on a view of g; if the schedule let the levels stop
+// early, the communities found are projected onto the nodes of g and the levels run again
+// from them, tight and uncapped, so that the finest levels converge too (the first passes
+// of the loose run do most of the moves, the tight run only moves the nodes left over)
+// dendrogram receives the levels of the tight run
+double run_schedule(const Graph& g, Community& c, bool pruning, bool refine, Dendrogram& dendrogram,
+    const ThresholdSchedule& schedule);
+
+// runs num_runs pipelines concurrently on read-only views of g (one thread each), run k
+// visiting the nodes in an order drawn from seed + k; returns the dendrogram of every run
+// and its modularity in modularities
+vector<Dendrogram> run_ensemble(const Graph& g, int num_runs, long seed, bool pruning, bool refine, int num_threads,
+    vector<double>& modularities, const ThresholdSchedule& schedule = ThresholdSchedule());
+
+// consensus of the partitions of an ensemble (Lancichinetti and Fortunato): every edge is
+// weighted by the fraction of partitions that put its two nodes together, edges kept by at
+// most half of them are dropped, and the communities of this graph are the consensus
+vector<int> consensus_partition(Graph& g, const vector<vector<int>>& partitions, int num_threads);
@@ -0,0 +1,169 @@
+#include "pipeline.hpp"
+#include "shards.hpp"
+
+// communities spread over num_groups groups of about as many entries: the largest
+// community first, always into the lightest group
+static vector<int> group_communities(const vector<unsigned long>& entries_of, int num_groups)
+{
+    int num_communities = entries_of.size();
+    vector<int> group_of(num_communities);
+    if (num_groups <= 0 || num_groups >= num_communities) {
+        for (int comm = 0; comm < num_communities; ++comm)
+            group_of[comm] = comm;
+        return group_of;
+    }
+
+    vector<int> order(num_communities);
+    for (int comm = 0; comm < num_communities; ++comm)
+        order[comm] = comm;
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return entries_of[a] > entries_of[b]; });
+    priority_queue<pair<unsigned long, int>, vector<pair<unsigned long, int>>, greater<pair<unsigned long, int>>> lightest;
+    for (int group = 0; group < num_groups; ++group)
+        lightest.push(make_pair(0UL, group));
+    for (int comm : order) {
+        pair<unsigned long, int> group = lightest.top();
+        lightest.pop();
+        group_of[comm] = group.second;
+        lightest.push(make_pair(group.first + entries_of[comm], group.second));
+    }
+    return group_of;
+}
+
+static void write_padded(ofstream& output, const void* data, size_t bytes)
+{
+    const char padding[8] = { 0 };
+    output.write((const char*)data, bytes);
+    output.write(padding, ((bytes + 7) & ~(size_t)7) - bytes);
+}
+
+// splits a graph into one .shard file per community (or group of communities) of a partition
+// usage: ./shards <graph> <partition.cm> <output prefix> [-g <groups>] [-t <threads>] [-W]
+// writes <prefix>-<k>.shard for every shard k and <prefix>.index
+// with -g the communities are packed into that many shards of about as many entries
+// with -W the edge list is read as "u v w" (a .bgr keeps its own weights)
+int main(int argc, char** argv)
+{
+    if (argc < 4) {
+        cerr << "usage: " << argv[0] << " <graph> <partition.cm> <output prefix> [-g <groups>] [-t <threads>] [-W]" << endl;
+        return 1;
+    }
+
+    string graph_path = argv[1];
+    string partition_path = argv[2];
+    string prefix = argv[3];
+    int num_groups = 0;
+    int num_threads = 1;
+    int type = UNWEIGHTED;
+    for (int i = 4; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "-g" && i + 1 < argc)
+            num_groups = atoi(argv[++i]);
+        else if (option == "-t" && i + 1 < argc)
+            num_threads = atoi(argv[++i]);
+        else if (option == "-W")
+            type = WEIGHTED;
+    }
+    if (num_threads <= 0)
+        num_threads = max(1u, thread::hardware_concurrency());
+
+    Graph g(graph_path, type, num_threads);
+    vector<int> partition = read_partition(partition_path, g);
+    bool weighted = g.weights.size() != 0;
+
+    int num_communities = 0;
+    for (int comm : partition)
+        num_communities = max(num_communities, comm + 1);
+    vector<unsigned long> entries_of(num_communities, 0);
+    for (int node = 0; node < g.num_nodes; ++node)
+        entries_of[partition[node]] += g.num_neighbors(node);
+    vector<int> group_of = group_communities(entries_of, num_groups);
+    int num_shards = 0;
+    for (int group : group_of)
+        num_shards = max(num_shards, group + 1);
+
+    // nodes of every shard in increasing node id, which gives their local ids
+    vector<int> shard_offsets(num_shards + 1, 0);
+    for (int node = 0; node < g.num_nodes; ++node)
+        ++shard_offsets[group_of[partition[node]] + 1];
+    for (int shard = 0; shard < num_shards; ++shard)
+        shard_offsets[shard + 1] += shard_offsets[shard];
+    vector<int> shard_nodes(g.num_nodes);
+    vector<int> local_id(g.num_nodes);
+    vector<int> where(shard_offsets.begin(), shard_offsets.end() - 1);
+    for (int node = 0; node < g.num_nodes; ++node) {
+        int shard = group_of[partition[node]];
+        local_id[node] = where[shard] - shard_offsets[shard];
+        shard_nodes[where[shard]++] = node;
+    }
+
+    vector<unsigned long> cut_of_shard(num_shards);
+    parallel_for(num_threads, 0, num_shards, [&](long shard, int) {
+        int first = shard_offsets[shard];
+        int num_nodes = shard_offsets[shard + 1] - first;
+
+        GraphShardHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, GRAPH_SHARD_MAGIC, sizeof(header.magic));
+        header.version = GRAPH_SHARD_VERSION;
+        header.flags = weighted ? GRAPH_SHARD_WEIGHTS : 0;
+        header.shard = shard;
+        header.num_shards = num_shards;
+        header.num_nodes = num_nodes;
+
+        vector<int> original_ids(num_nodes);
+        vector<unsigned long> degrees(num_nodes);
+        vector<int> links;
+        vector<float> weights;
+        vector<CutEdge> cut_edges;
+        for (int k = 0; k < num_nodes; ++k) {
+            int node = shard_nodes[first + k];
+            original_ids[k] = g.node_id_to_original_id[node];
+            pair<unsigned long, unsigned long> indices = g.neighbors(node);
+            for (int i = 0; i < g.num_neighbors(node); ++i) {
+                int neigh = g.links[indices.first + i];
+                int neigh_shard = group_of[partition[neigh]];
+                if (neigh_shard == shard) {
+                    links.push_back(local_id[neigh]);
+                } else {
+                    links.push_back(-1 - (int)cut_edges.size());
+                    cut_edges.push_back({ neigh_shard, local_id[neigh] });
+                }
+                if (weighted)
+                    weights.push_back(g.weights[indices.second + i]);
+            }
+            degrees[k] = links.size();
+        }
+        header.num_entries = links.size();
+        header.num_cut_edges = cut_edges.size();
+        cut_of_shard[shard] = cut_edges.size();
+
+        ofstream output(prefix + "-" + to_string(shard) + ".shard", ios::binary);
+        assert(output.good());
+        output.write((const char*)&header, sizeof(header));
+        write_padded(output, original_ids.data(), original_ids.size() * sizeof(int));
+        write_padded(output, degrees.data(), degrees.size() * sizeof(uint64_t));
+        write_padded(output, links.data(), links.size() * sizeof(int));
+        if (weighted)
+            write_padded(output, weights.data(), weights.size() * sizeof(float));
+        write_padded(output, cut_edges.data(), cut_edges.size() * sizeof(CutEdge));
+        assert(output.good());
+    }, 1);
+
+    // where every original id lives
+    uint64_t num_ids = g.original_id_to_node_id.size();
+    vector<CutEdge> index(num_ids, { -1, -1 });
+    for (int node = 0; node < g.num_nodes; ++node)
+        index[g.node_id_to_original_id[node]] = { group_of[partition[node]], local_id[node] };
+    ofstream output(prefix + ".index", ios::binary);
+    assert(output.good());
+    output.write((const char*)&num_ids, sizeof(num_ids));
+    output.write((const char*)index.data(), num_ids * sizeof(CutEdge));
+    assert(output.good());
+
+    unsigned long num_cut = 0;
+    for (unsigned long cut : cut_of_shard)
+        num_cut += cut;
+    cerr << prefix << " : " << num_shards << " shards of " << num_communities << " communities, "
+         << g.num_nodes << " nodes, " << num_cut / 2 << " cut edges of " << g.num_links << " links." << endl;
+    return 0;
+}
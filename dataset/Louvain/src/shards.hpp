@@ -0,0 +1,74 @@
+#pragma once
+#include "graph.hpp"
+
+// on-disk shard of a graph (.shard): the nodes of one community, or of a group of them,
+// written by ./shards from a graph and its .cm file, so that every server of a walk maps
+// only its own part
+//   header
+//   original ids int32  x num_nodes      id of every local node in the graph file
+//   degrees      uint64 x num_nodes      cumulative degree sequence, as in a .bgr
+//   links        int32  x num_entries    local id, or -1 - k for the cut edge k
+//   weights      float  x num_entries    (only with GRAPH_SHARD_WEIGHTS)
+//   cut edges    CutEdge x num_cut_edges neighbors in other shards
+// every array is padded to 8 bytes
+// the .index file next to the shards holds a uint64 count and then the CutEdge (shard and
+// local id) of every original id up to it, -1 -1 for the ids without a node
+#define GRAPH_SHARD_MAGIC "LVSHARD"
+#define GRAPH_SHARD_VERSION 1
+#define GRAPH_SHARD_WEIGHTS 1
+
+struct GraphShardHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t shard;
+    uint32_t num_shards;
+    uint64_t num_nodes;
+    uint64_t num_entries;
+    uint64_t num_cut_edges;
+};
+
+// a neighbor in another shard, by its shard and local id there
+struct CutEdge {
+    int32_t shard;
+    int32_t node;
+};
+
+// a .shard file mapped read-only
+class GraphShard {
+public:
+    GraphShardHeader header;
+    const int* original_ids;
+    const unsigned long* degrees;
+    const int* links;
+    const float* weights;
+    const CutEdge* cut_edges;
+
+    GraphShard(string filepath)
+        : file(filepath, MADV_NORMAL)
+    {
+        assert(file.size >= sizeof(GraphShardHeader));
+        header = *(const GraphShardHeader*)file.data;
+        assert(memcmp(header.magic, GRAPH_SHARD_MAGIC, sizeof(header.magic)) == 0);
+        assert(header.version == GRAPH_SHARD_VERSION);
+
+        size_t offset = sizeof(GraphShardHeader);
+        auto next = [&](size_t bytes) {
+            const char* p = file.data + offset;
+            offset += (bytes + 7) & ~(size_t)7;
+            return p;
+        };
+        original_ids = (const int*)next(header.num_nodes * sizeof(int));
+        degrees = (const unsigned long*)next(header.num_nodes * sizeof(uint64_t));
+        links = (const int*)next(header.num_entries * sizeof(int));
+        weights = (header.flags & GRAPH_SHARD_WEIGHTS) ? (const float*)next(header.num_entries * sizeof(float)) : NULL;
+        cut_edges = (const CutEdge*)next(header.num_cut_edges * sizeof(CutEdge));
+        assert(offset <= file.size);
+    }
+
+    int num_nodes() const { return header.num_nodes; }
+    unsigned long first_neighbor(int node) const { return (node == 0) ? 0 : degrees[node - 1]; }
+
+private:
+    MappedFile file;
+};
@@ -0,0 +1,257 @@
+#pragma once
+#include "header.hpp"
+#include <sys/resource.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+// hardware counters read around a phase
+#define NUM_COUNTERS 4
+#define COUNTER_CYCLES 0
+#define COUNTER_INSTRUCTIONS 1
+#define COUNTER_CACHE_MISSES 2
+#define COUNTER_BRANCH_MISSES 3
+
+static const char* counter_names[NUM_COUNTERS] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+
+// user-space cycles, instructions, cache misses and branch misses of the process, threads
+// started after start() included (they are folded in when they are joined)
+// perf_event_open is Linux only; elsewhere, or when the kernel refuses, every value is -1
+class PerfCounters {
+public:
+    PerfCounters()
+    {
+        for (int i = 0; i < NUM_COUNTERS; ++i)
+            fds[i] = -1;
+    }
+
+    ~PerfCounters() { close_all(); }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    void start()
+    {
+#if defined(__linux__)
+        static const uint64_t configs[NUM_COUNTERS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+        for (int i = 0; i < NUM_COUNTERS; ++i) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            if (fds[i] >= 0) {
+                ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    void stop(long values[NUM_COUNTERS])
+    {
+        for (int i = 0; i < NUM_COUNTERS; ++i) {
+            values[i] = -1;
+#if defined(__linux__)
+            uint64_t count;
+            if (fds[i] >= 0) {
+                ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+                if (read(fds[i], &count, sizeof(count)) == sizeof(count))
+                    values[i] = count;
+            }
+#endif
+        }
+        close_all();
+    }
+
+private:
+    int fds[NUM_COUNTERS];
+
+    void close_all()
+    {
+        for (int i = 0; i < NUM_COUNTERS; ++i) {
+            if (fds[i] >= 0)
+                close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+};
+
+// wall-clock time of every phase of a run (load, passes, contraction, output),
+// collected for the benchmark and written with the run summary by write_csv / write_json
+// level and pass are -1 for phases that do not belong to one
+// counters are only read when Stats::counters is set, and are -1 otherwise
+struct PhaseRecord {
+    string phase;
+    int level;
+    int pass;
+    double seconds;
+    long counters[NUM_COUNTERS];
+};
+
+class Stats {
+public:
+    vector<PhaseRecord> records;
+
+    // level the phases recorded now belong to, set by the driver
+    int level;
+
+    // read the hardware counters around every phase
+    bool counters;
+
+    Stats()
+        : level(-1)
+        , counters(false)
+    {
+    }
+
+    void add(string phase, int pass, double seconds, const long values[NUM_COUNTERS])
+    {
+        PhaseRecord record = { phase, level, pass, seconds, { 0 } };
+        for (int i = 0; i < NUM_COUNTERS; ++i)
+            record.counters[i] = values[i];
+        records.push_back(record);
+    }
+
+    // one line per phase, grouped by level, with instructions per cycle and
+    // cache and branch misses per thousand instructions
+    void print_counters(ostream& output)
+    {
+        output << "\nlevel  phase        pass  seconds      cycles          instructions    IPC    cache-MPKI  branch-MPKI" << endl;
+        for (const PhaseRecord& r : records) {
+            const long* c = r.counters;
+            char line[256];
+            if (c[COUNTER_CYCLES] < 0 || c[COUNTER_INSTRUCTIONS] <= 0) {
+                snprintf(line, sizeof(line), "%5d  %-11s  %4d  %-11.6f  (counters unavailable)",
+                    r.level, r.phase.c_str(), r.pass, r.seconds);
+            } else {
+                double kilo_instructions = c[COUNTER_INSTRUCTIONS] / 1000.0;
+                snprintf(line, sizeof(line), "%5d  %-11s  %4d  %-11.6f  %-14ld  %-14ld  %-5.2f  %-10.2f  %.2f",
+                    r.level, r.phase.c_str(), r.pass, r.seconds, c[COUNTER_CYCLES], c[COUNTER_INSTRUCTIONS],
+                    (double)c[COUNTER_INSTRUCTIONS] / max(1L, c[COUNTER_CYCLES]),
+                    c[COUNTER_CACHE_MISSES] / kilo_instructions, c[COUNTER_BRANCH_MISSES] / kilo_instructions);
+            }
+            output << line << endl;
+        }
+    }
+
+    // peak resident set size of the process so far, in KB
+    static long peak_rss_kb()
+    {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#if defined(__MACH__)
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+
+    // appends one row per phase and a "total" row carrying the modularity and the peak RSS
+    // columns: graph,threads,seed,phase,level,pass,seconds,modularity,peak_rss_kb,
+    //          cycles,instructions,cache_misses,branch_misses
+    void write_csv(string filepath, string graph, int threads, long seed, double total_seconds, double modularity)
+    {
+        bool empty = true;
+        {
+            ifstream finput(filepath);
+            empty = !finput.good() || finput.peek() == ifstream::traits_type::eof();
+        }
+        ofstream output(filepath, ios::app);
+        assert(output.good());
+        if (empty)
+            output << "graph,threads,seed,phase,level,pass,seconds,modularity,peak_rss_kb,"
+                   << "cycles,instructions,cache_misses,branch_misses\n";
+        output.precision(9);
+        for (const PhaseRecord& r : records) {
+            output << graph << "," << threads << "," << seed << "," << r.phase << ","
+                   << r.level << "," << r.pass << "," << r.seconds << ",,";
+            for (int i = 0; i < NUM_COUNTERS; ++i)
+                output << "," << r.counters[i];
+            output << "\n";
+        }
+        output << graph << "," << threads << "," << seed << ",total,-1,-1," << total_seconds << ","
+               << modularity << "," << peak_rss_kb() << ",-1,-1,-1,-1\n";
+    }
+
+    // appends the run as one JSON object per line
+    void write_json(string filepath, string graph, int threads, long seed, double total_seconds, double modularity)
+    {
+        ofstream output(filepath, ios::app);
+        assert(output.good());
+        output.precision(9);
+        output << "{\"graph\": \"" << graph << "\", \"threads\": " << threads << ", \"seed\": " << seed
+               << ", \"seconds\": " << total_seconds << ", \"modularity\": " << modularity
+               << ", \"peak_rss_kb\": " << peak_rss_kb() << ", \"phases\": [";
+        for (size_t i = 0; i < records.size(); ++i) {
+            const PhaseRecord& r = records[i];
+            output << (i == 0 ? "" : ", ") << "{\"phase\": \"" << r.phase << "\", \"level\": " << r.level
+                   << ", \"pass\": " << r.pass << ", \"seconds\": " << r.seconds;
+            for (int i = 0; i < NUM_COUNTERS; ++i)
+                output << ", \"" << counter_names[i] << "\": " << r.counters[i];
+            output << "}";
+        }
+        output << "]}\n";
+    }
+};
+
+// phases of the current run of this thread, NULL (the default) records nothing: the louvain
+// command points it at the Stats it writes out, and louvain() at LouvainOptions::stats for the
+// duration of the call, so a library caller only accumulates phases if it asked for them
+// it is per thread so that concurrent runs (ensemble mode) do not mix their phases; the runs
+// of an ensemble record nothing
+inline thread_local Stats* run_stats = NULL;
+
+// level the phases recorded now belong to, if phases are recorded
+inline void set_stats_level(int level)
+{
+    if (run_stats != NULL)
+        run_stats->level = level;
+}
+
+// records the time between its construction and its destruction (or stop()) as a phase of
+// run_stats (as of the construction), with the hardware counters of that span when
+// run_stats->counters is set
+class PhaseTimer {
+public:
+    PhaseTimer(string name, int pass = -1)
+        : phase(name)
+        , pass_number(pass)
+        , running(true)
+        , stats(run_stats)
+    {
+        if (stats != NULL && stats->counters)
+            counters.start();
+        start = chrono::steady_clock::now();
+    }
+
+    ~PhaseTimer() { stop(); }
+
+    // seconds since the start, recorded the first time only
+    double stop()
+    {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (running && stats != NULL) {
+            long values[NUM_COUNTERS];
+            counters.stop(values);
+            stats->add(phase, pass_number, seconds, values);
+        }
+        running = false;
+        return seconds;
+    }
+
+private:
+    string phase;
+    int pass_number;
+    chrono::steady_clock::time_point start;
+    bool running;
+    Stats* stats;
+    PerfCounters counters;
+};
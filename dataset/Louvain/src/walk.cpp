@@ -0,0 +1,159 @@
+#include "walk.hpp"
+
+// random walks with a stop probability on a graph, the native version of
+// base/node-base/baseRW.py, printing its "Average length / Total length / Total time" lines
+// with -f, the walks of before.py and after.py that never step onto a Private node
+// usage: ./walk <graph> [-n <walks>] [-a <alpha>] [-v <start>] [-t <threads>] [-s <seed>] [-W]
+//               [-f <attributes> [-l <label>] [-P filter|resample|both] [-r <repeats>]]
+//   -n <walks>   : number of walks (default 100)
+//   -a <alpha>   : stop probability before every step (default 0.1)
+//   -v <start>   : original id of the start node (default 1), -1 for a random start per walk
+//   -t <threads> : threads running the batches of walks (0 = all cores)
+//   -s <seed>    : seed of the walks (default: time)
+//   -W           : weighted edge list, the walks still choose neighbors uniformly
+//   -f <file>    : "<original id> <label>" lines, the nodes with the forbidden label are never
+//                  stepped onto
+//   -l <label>   : forbidden label (default Private)
+//   -P <policy>  : filter (among the allowed neighbors), resample (among all neighbors until an
+//                  allowed one), or both (default), which also prints their throughput ratio
+//   -r <repeats> : with -P both, timed runs of each policy after an untimed warm-up run of
+//                  each, alternating which goes first; the median times are reported (default 5)
+
+// prints the lines of a set of walks that took that many seconds, returns the walks per second
+static double print_walks(const WalkStats& stats, double seconds, double alpha)
+{
+    double walks_per_second = (seconds > 0) ? stats.num_walks / seconds : 0;
+    cout << "Average length: " << stats.average() << endl;
+    cout << "Total length: " << stats.total_length << endl;
+    cout << "Total time: " << seconds << endl;
+
+    double variance = stats.num_walks == 0 ? 0 : stats.sum_squares / stats.num_walks - stats.average() * stats.average();
+    cerr << stats.num_walks << " walks, max length " << stats.max_length << ", standard deviation "
+         << sqrt(max(0., variance)) << ", " << walks_per_second << " walks/s"
+         << " (expected average length " << 1 / alpha << " without dead ends)" << endl;
+    return walks_per_second;
+}
+
+// runs the walks of one policy, and their time in seconds
+static WalkStats time_walks(Graph& g, int start, unsigned long num_walks, double alpha, int num_threads, uint64_t seed,
+    int policy, const NodeAttributes* forbidden, const AllowedAdjacency* allowed, double& seconds)
+{
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    WalkStats stats = run_walks(g, start, num_walks, alpha, num_threads, seed, policy, forbidden, allowed);
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    return stats;
+}
+
+static double median(vector<double> values)
+{
+    sort(values.begin(), values.end());
+    int n = values.size();
+    return (n % 2 == 1) ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <graph> [-n <walks>] [-a <alpha>] [-v <start>] [-t <threads>] [-s <seed>] [-W]"
+             << " [-f <attributes> [-l <label>] [-P filter|resample|both] [-r <repeats>]]" << endl;
+        return 1;
+    }
+
+    string filepath = argv[1];
+    unsigned long num_walks = 100;
+    double alpha = 0.1;
+    int start_id = 1;
+    int num_threads = 1;
+    uint64_t seed = time(NULL);
+    int type = UNWEIGHTED;
+    string attributes_path, forbidden_label = "Private", policy = "both";
+    int repeats = 5;
+    for (int i = 2; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "-n" && i + 1 < argc)
+            num_walks = atol(argv[++i]);
+        else if (option == "-a" && i + 1 < argc)
+            alpha = atof(argv[++i]);
+        else if (option == "-v" && i + 1 < argc)
+            start_id = atoi(argv[++i]);
+        else if (option == "-t" && i + 1 < argc)
+            num_threads = atoi(argv[++i]);
+        else if (option == "-s" && i + 1 < argc)
+            seed = atol(argv[++i]);
+        else if (option == "-W")
+            type = WEIGHTED;
+        else if (option == "-f" && i + 1 < argc)
+            attributes_path = argv[++i];
+        else if (option == "-l" && i + 1 < argc)
+            forbidden_label = argv[++i];
+        else if (option == "-P" && i + 1 < argc)
+            policy = argv[++i];
+        else if (option == "-r" && i + 1 < argc)
+            repeats = atoi(argv[++i]);
+    }
+    assert(policy == "filter" || policy == "resample" || policy == "both");
+    assert(repeats > 0);
+    if (num_threads <= 0)
+        num_threads = max(1u, thread::hardware_concurrency());
+
+    Graph g(filepath, type, num_threads);
+    int start = -1;
+    if (start_id >= 0) {
+        assert(start_id < g.original_id_to_node_id.size() && g.original_id_to_node_id[start_id] >= 0);
+        start = g.original_id_to_node_id[start_id];
+    }
+
+    cout.precision(12);
+    double seconds;
+    if (attributes_path.empty()) {
+        WalkStats stats = time_walks(g, start, num_walks, alpha, num_threads, seed, WALK_UNCONSTRAINED, NULL, NULL, seconds);
+        print_walks(stats, seconds, alpha);
+        return 0;
+    }
+
+    NodeAttributes forbidden(g, attributes_path, forbidden_label);
+    cerr << forbidden.num_set << " " << forbidden_label << " nodes" << endl;
+
+    // the resample policy only reads the bitset
+    unique_ptr<AllowedAdjacency> allowed;
+    if (policy != "resample") {
+        chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+        allowed.reset(new AllowedAdjacency(g, forbidden, num_threads));
+        cerr << "allowed adjacency built in " << chrono::duration<double>(chrono::steady_clock::now() - begin).count()
+             << "s" << endl;
+    }
+
+    if (policy != "both") {
+        int p = (policy == "filter") ? WALK_FILTER : WALK_RESAMPLE;
+        WalkStats stats = time_walks(g, start, num_walks, alpha, num_threads, seed, p, &forbidden, allowed.get(), seconds);
+        print_walks(stats, seconds, alpha);
+        return 0;
+    }
+
+    // the first run of a policy pays for the cold caches (and page faults) of its arrays,
+    // so both run once untimed, then the timed runs alternate which policy goes first
+    // every run uses the same seed: the walks of a policy are the same on every repeat, and
+    // resample, which draws again on forbidden neighbors, has other walks than filter but
+    // with the same distribution
+    const int policies[2] = { WALK_FILTER, WALK_RESAMPLE };
+    WalkStats stats[2];
+    vector<double> times[2];
+    for (int p = 0; p < 2; ++p)
+        time_walks(g, start, num_walks, alpha, num_threads, seed, policies[p], &forbidden, allowed.get(), seconds);
+    for (int r = 0; r < repeats; ++r) {
+        for (int k = 0; k < 2; ++k) {
+            int p = (r % 2 == 0) ? k : 1 - k;
+            stats[p] = time_walks(g, start, num_walks, alpha, num_threads, seed, policies[p], &forbidden, allowed.get(), seconds);
+            times[p].push_back(seconds);
+        }
+    }
+
+    cout << "=== filter (before.py) ===" << endl;
+    double filter_rate = print_walks(stats[0], median(times[0]), alpha);
+    cout << "=== resample (after.py) ===" << endl;
+    double resample_rate = print_walks(stats[1], median(times[1]), alpha);
+    cerr << "median of " << repeats << " runs of each policy after a warm-up run" << endl;
+    if (resample_rate > 0)
+        cout << "Filter / resample throughput: " << filter_rate / resample_rate << endl;
+    return 0;
+}
@@ -0,0 +1,238 @@
+#pragma once
+#include "graph.hpp"
+
+// xoshiro256** (Blackman and Vigna), seeded through splitmix64: a few cycles per draw and
+// 32 bytes of state, so every batch of walks gets its own generator
+class WalkRandom {
+public:
+    WalkRandom(uint64_t seed)
+    {
+        for (int i = 0; i < 4; ++i)
+            state[i] = splitmix64(seed);
+    }
+
+    static uint64_t splitmix64(uint64_t& x)
+    {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    inline uint64_t next()
+    {
+        uint64_t result = rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    // uniform in (0, 1]
+    inline double uniform() { return ((next() >> 11) + 1) * 0x1.0p-53; }
+
+    // uniform in [0, n), by a multiply instead of a modulo (the bias is below n / 2^32)
+    inline uint32_t below(uint32_t n) { return (uint32_t)(((next() >> 32) * (uint64_t)n) >> 32); }
+
+private:
+    uint64_t state[4];
+
+    static inline uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+// lengths of a batch of walks; a walk of k steps visits k + 1 nodes and has length k + 1,
+// as len(path) in base/node-base/baseRW.py
+struct WalkStats {
+    unsigned long num_walks = 0;
+    unsigned long total_length = 0;
+    unsigned long max_length = 0;
+    double sum_squares = 0;
+
+    void add(unsigned long length)
+    {
+        ++num_walks;
+        total_length += length;
+        max_length = max(max_length, length);
+        sum_squares += (double)length * length;
+    }
+
+    void add(const WalkStats& other)
+    {
+        num_walks += other.num_walks;
+        total_length += other.total_length;
+        max_length = max(max_length, other.max_length);
+        sum_squares += other.sum_squares;
+    }
+
+    double average() const { return num_walks == 0 ? 0 : (double)total_length / num_walks; }
+};
+
+// one bit per node of a graph, set for the nodes with a given label in a "<original id> <label>"
+// file (dataset/node-base/karate.txt marks nodes Public or Private); 34 nodes fit in one word
+class NodeAttributes {
+public:
+    vector<uint64_t> bits;
+    int num_set = 0;
+
+    NodeAttributes(const Graph& g, string filepath, string label)
+        : bits((g.num_nodes + 63) / 64, 0)
+    {
+        ifstream finput(filepath);
+        assert(finput.good());
+        int original;
+        string node_label;
+        while (finput >> original >> node_label) {
+            if (node_label != label || original < 0 || original >= g.original_id_to_node_id.size()
+                || g.original_id_to_node_id[original] < 0)
+                continue;
+            int node = g.original_id_to_node_id[original];
+            num_set += !test(node);
+            bits[node >> 6] |= 1ULL << (node & 63);
+        }
+    }
+
+    inline bool test(int node) const { return (bits[node >> 6] >> (node & 63)) & 1; }
+};
+
+// neighbor lists of g with the allowed neighbors (not in forbidden) first: links has the
+// offsets of g.links and the first num_allowed[node] entries of a node are its allowed
+// neighbors, so a constrained step is one draw below num_allowed[node]
+class AllowedAdjacency {
+public:
+    vector<int> links;
+    vector<int> num_allowed;
+
+    AllowedAdjacency(Graph& g, const NodeAttributes& forbidden, int nthreads)
+        : links(g.links.size())
+        , num_allowed(g.num_nodes)
+    {
+        parallel_for(nthreads, 0, g.num_nodes, [&](long node, int) {
+            unsigned long first = g.neighbors(node).first;
+            unsigned long end = first + g.num_neighbors(node);
+            unsigned long allowed = first, forbidden_end = end;
+            for (unsigned long i = first; i < end; ++i) {
+                int neigh = g.links[i];
+                if (forbidden.test(neigh))
+                    links[--forbidden_end] = neigh;
+                else
+                    links[allowed++] = neigh;
+            }
+            num_allowed[node] = allowed - first;
+        });
+    }
+};
+
+// walks on the CSR of g: every walk stops with probability alpha before each step (its
+// number of steps is drawn once, geometrically, instead of one draw per step) and moves to a
+// uniformly chosen neighbor; a node without neighbors ends the walk
+// with a policy other than WALK_UNCONSTRAINED walks never step onto a forbidden node:
+//   WALK_FILTER   : draws among the allowed neighbors of the AllowedAdjacency, as
+//                   base/node-base/before.py
+//   WALK_RESAMPLE : draws among all neighbors and draws again on a forbidden one, as
+//                   base/node-base/after.py; after WALK_RESAMPLE_DRAWS forbidden draws it
+//                   counts the allowed neighbors, so a node with none ends the walk
+// both choose uniformly among the allowed neighbors, a node without one ends the walk
+// start is a node of g, or -1 for a uniformly chosen start node per walk
+// walks are run in batches of WALK_BATCH on nthreads threads; batch b draws from the seed
+// seed + b, so the lengths do not depend on the number of threads
+#define WALK_BATCH 4096
+#define WALK_UNCONSTRAINED 0
+#define WALK_FILTER 1
+#define WALK_RESAMPLE 2
+#define WALK_RESAMPLE_DRAWS 16
+
+// step(node, random) returns the next node, or -1 to end the walk
+template <typename Step>
+inline unsigned long walk_once(int node, double log_continue, WalkRandom& random, Step step)
+{
+    unsigned long steps = (log_continue < 0) ? (unsigned long)(log(random.uniform()) / log_continue) : ULONG_MAX;
+    unsigned long length = 1;
+    for (; length <= steps; ++length) {
+        node = step(node, random);
+        if (node < 0)
+            break;
+    }
+    return length;
+}
+
+template <typename Step>
+inline WalkStats run_walks(int num_nodes, int start, unsigned long num_walks, double alpha, int nthreads, uint64_t seed,
+    Step step)
+{
+    assert(alpha > 0 && alpha <= 1);
+    assert(start >= -1 && start < num_nodes);
+    double log_continue = log1p(-alpha);
+
+    // one slot per thread, a cache line apart
+    struct alignas(64) PaddedStats {
+        WalkStats stats;
+    };
+    vector<PaddedStats> stats_of_thread(max(1, nthreads));
+    long num_batches = (num_walks + WALK_BATCH - 1) / WALK_BATCH;
+    parallel_for(nthreads, 0, num_batches, [&](long batch, int thread_id) {
+        WalkRandom random(seed + batch);
+        WalkStats& stats = stats_of_thread[thread_id].stats;
+        unsigned long first = batch * WALK_BATCH;
+        unsigned long last = min(num_walks, first + WALK_BATCH);
+        for (unsigned long walk = first; walk < last; ++walk) {
+            int node = (start >= 0) ? start : random.below(num_nodes);
+            stats.add(walk_once(node, log_continue, random, step));
+        }
+    }, 1);
+
+    WalkStats total;
+    for (const PaddedStats& s : stats_of_thread)
+        total.add(s.stats);
+    return total;
+}
+
+// forbidden and allowed are only read by the constrained policies
+inline WalkStats run_walks(Graph& g, int start, unsigned long num_walks, double alpha, int nthreads, uint64_t seed,
+    int policy = WALK_UNCONSTRAINED, const NodeAttributes* forbidden = NULL, const AllowedAdjacency* allowed = NULL)
+{
+    if (policy == WALK_FILTER) {
+        assert(allowed != NULL);
+        return run_walks(g.num_nodes, start, num_walks, alpha, nthreads, seed, [&](int node, WalkRandom& random) {
+            int count = allowed->num_allowed[node];
+            if (count == 0)
+                return -1;
+            return allowed->links[g.neighbors(node).first + random.below(count)];
+        });
+    }
+
+    if (policy == WALK_RESAMPLE) {
+        assert(forbidden != NULL);
+        return run_walks(g.num_nodes, start, num_walks, alpha, nthreads, seed, [&](int node, WalkRandom& random) {
+            int deg = g.num_neighbors(node);
+            if (deg == 0)
+                return -1;
+            const int* neighbors = g.links.data() + g.neighbors(node).first;
+            for (int draw = 0; draw < WALK_RESAMPLE_DRAWS; ++draw) {
+                int next = neighbors[random.below(deg)];
+                if (!forbidden->test(next))
+                    return next;
+            }
+            // mostly forbidden neighbors: the k-th allowed one, still uniform among them
+            int count = 0;
+            for (int i = 0; i < deg; ++i)
+                count += !forbidden->test(neighbors[i]);
+            if (count == 0)
+                return -1;
+            int k = random.below(count);
+            for (int i = 0;; ++i)
+                if (!forbidden->test(neighbors[i]) && k-- == 0)
+                    return neighbors[i];
+        });
+    }
+
+    return run_walks(g.num_nodes, start, num_walks, alpha, nthreads, seed, [&](int node, WalkRandom& random) {
+        int deg = g.num_neighbors(node);
+        if (deg == 0)
+            return -1;
+        return g.links[g.neighbors(node).first + random.below(deg)];
+    });
+}